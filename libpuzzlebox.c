@@ -0,0 +1,1922 @@
+// Puzzle box maker - maze library
+// (c) 2018 Adrian Kennard www.me.uk @TheRealRevK
+// This includes a distinctive "A" in the design at the final park point, otherwise there are no loops in the maze
+// Please leave the "A" in the design as a distinctive feature
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <err.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "puzzlebox.h"
+
+static pb_stats_t pb_stats;     // Totals from threads that have finished counting
+static pthread_mutex_t pb_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static __thread pb_stats_t pb_counts;   // This thread's counts, so counting needs no locks or atomics
+
+typedef unsigned long long pb_bits_t;   // A word of a bit plane, bit x % 64 of word x / 64 for column x
+
+/**
+ * Adds this thread's counts to the totals.
+ */
+static void
+pb_stats_flush (void)
+{
+   pthread_mutex_lock (&pb_stats_mutex);
+   pb_stats.mazes += pb_counts.mazes;
+   pb_stats.steps += pb_counts.steps;
+   pb_stats.deadends += pb_counts.deadends;
+   pb_stats.tests += pb_counts.tests;
+   pb_stats.probes += pb_counts.probes;
+   pb_stats.draws += pb_counts.draws;
+   if (pb_counts.frontier > pb_stats.frontier)
+      pb_stats.frontier = pb_counts.frontier;
+   pthread_mutex_unlock (&pb_stats_mutex);
+   memset (&pb_counts, 0, sizeof (pb_counts));
+}
+
+/**
+ * Gets the counters so far, for all threads (search threads add theirs when they finish).
+ *
+ * @param s Counters
+ */
+void
+pb_stats_get (pb_stats_t * s)
+{
+   pb_stats_flush ();
+   pthread_mutex_lock (&pb_stats_mutex);
+   *s = pb_stats;
+   pthread_mutex_unlock (&pb_stats_mutex);
+}
+
+/**
+ * Seeds the generator, expanding the seed with splitmix64 so similar seeds give unrelated streams.
+ *
+ * @param r Generator state
+ * @param seed Seed
+ */
+void
+pb_rng_seed (pb_rng_t * r, unsigned long long seed)
+{
+   int i;
+   for (i = 0; i < 4; i++)
+   {
+      unsigned long long z = (seed += 0x9E3779B97F4A7C15ULL);
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+      r->s[i] = z ^ (z >> 31);
+   }
+}
+
+/**
+ * Returns the next 64 random bits.
+ *
+ * @param r Generator state
+ * @return Random value
+ */
+unsigned long long
+pb_rng_next (pb_rng_t * r)
+{
+   unsigned long long *s = r->s,
+      v = s[1] * 5,
+      t = s[1] << 17;
+   pb_counts.draws++;
+   v = ((v << 7) | (v >> 57)) * 9;
+   s[2] ^= s[0];
+   s[3] ^= s[1];
+   s[1] ^= s[2];
+   s[0] ^= s[3];
+   s[2] ^= t;
+   s[3] = (s[3] << 45) | (s[3] >> 19);
+   return v;
+}
+
+/**
+ * Returns a random number from 0 to n-1.
+ *
+ * @param r Generator state
+ * @param n Range (must be non zero)
+ * @return Random value
+ */
+unsigned int
+pb_rng_range (pb_rng_t * r, unsigned int n)
+{
+   return ((pb_rng_next (r) >> 32) * n) >> 32;
+}
+
+/**
+ * Tests if a maze cell is already in use or out of bounds.
+ * Handles wrapping around the X axis (cylindrical topology) and
+ * checking the FLAGI (invalid) flag, for each nub's copy of the maze.
+ *
+ * @param m Maze
+ * @param x X coordinate (wraps around cylinder)
+ * @param y Y coordinate (height)
+ * @return Flags in use (FLAGI if invalid), 0 if available
+ */
+unsigned char
+pb_maze_test (const pb_maze_t * m, int x, int y)
+{
+   int W = m->W,
+      H = m->H,
+      helix = m->helix,
+      abs_helix = helix < 0 ? -helix : helix;
+   pb_counts.tests++;
+   while (x < 0)
+   {
+      x += W;
+      y -= helix;
+   }
+   while (x >= W)
+   {
+      x -= W;
+      y += helix;
+   }
+   int n = m->nubs;
+   unsigned char v = 0;
+   while (n--)
+   {
+      if (y < 0 || y >= H)
+         v |= FLAGI;
+      else
+         v |= m->maze[x * H + y];
+      if (!n)
+         break;
+      x += W / m->nubs;
+      while (x >= W)
+      {
+         x -= W;
+         y += helix;
+      }
+      if (abs_helix == m->nubs) // adjust for half-rotation height offset
+         y -= (helix > 0 ? 1 : -1);     // +helix: band climbs right, correct down; -helix: band falls right, correct up
+   }
+   return v;
+}
+
+/**
+ * Works out the maze size, and where it is cut off top and bottom, for a maze on a wall.
+ * p->step, p->helix, p->nubs, p->inside and p->parkvertical need to be set first.
+ *
+ * @param p What to make, W, H, y0, dy, low and high are set
+ * @param r Radius of the wall the maze is on
+ * @param mazethickness Maze thickness
+ * @param base Height of the bottom of the maze area
+ * @param height Height of the part
+ * @param margin Maze top margin
+ * @param topspace Space above the maze
+ * @return 0 on success, 1 if too small
+ */
+int
+pb_maze_size (pb_params_t * p, double r, double mazethickness, double base, double height, double margin, double topspace)
+{
+   double mazestep = p->step;
+   int abs_helix = p->helix < 0 ? -p->helix : p->helix;
+   p->W = ((int) ((r + (p->inside ? mazethickness : -mazethickness)) * 2 * M_PI / mazestep)) / p->nubs * p->nubs;
+   double h = height - base - margin - topspace - (p->parkvertical ? mazestep / 4 : 0) - mazestep / 8;
+   p->H = (int) (h / mazestep);
+   p->y0 = base + mazestep / 2 - mazestep * (abs_helix + 1) + mazestep / 8;
+   p->H += 2 + abs_helix;       // Allow one above, one below and abs(helix) below
+   p->dy = 0;
+   if (p->helix && p->W)
+      p->dy = mazestep * p->helix / p->W;      // signed: controls twist direction
+   p->low = base + mazestep / 2 + mazestep / 8;
+   p->high = height - mazestep / 2 - margin - mazestep / 8;
+   if (p->W < 3 || p->H < 1)
+      return 1;
+   return 0;
+}
+
+/**
+ * Makes a random maze - marks the cells out of range, the park point (and "A"), then
+ * grows the maze from the park point. The exit is the longest path that reaches the top.
+ * While growing, a busy bit plane (folded to one nub's segment where it can be) stands in for test() on the way to go.
+ * With targets, no vertical run is longer than maxvertical, and until there is a path to the top of
+ * minsolution cells each new point is taken next, so it grows one long path first.
+ *
+ * @param m Maze to make, m->maze is used if set (W*H cells), else allocated
+ * @param p What to make
+ * @param rng Random numbers
+ * @return 0 on success, 1 on error
+ */
+int
+pb_maze_generate (pb_maze_t * m, const pb_params_t * p, pb_rng_t * rng)
+{
+   int W = p->W,
+      H = p->H,
+      helix = p->helix,
+      nubs = p->nubs,
+      abs_helix = helix < 0 ? -helix : helix;
+   int X = 0,
+      Y = 0,
+      N;
+   if (W < 3 || H < 1 || nubs < 1)
+   {
+      warnx ("Too small");
+      return 1;
+   }
+   m->W = W;
+   m->H = H;
+   m->helix = helix;
+   m->nubs = nubs;
+   m->exit_x = 0;
+   m->exit_y = -1;
+   m->path = 0;
+   if (!m->maze)
+   {
+      m->maze = malloc (W * H);
+      if (!m->maze)
+      {
+         warnx ("malloc");
+         return 1;
+      }
+      m->allocated = 1;
+   }
+   memset (m->maze, 0, W * H);
+   unsigned char (*maze)[H] = (void *) m->maze;
+   int test (int x, int y)
+   {
+      return pb_maze_test (m, x, y);
+   }
+   // Clear too high/low
+   for (Y = 0; Y < H; Y++)
+      for (X = 0; X < W; X++)
+         if (p->step * Y + p->y0 + p->dy * X < p->low || p->step * Y + p->y0 + p->dy * X > p->high)
+            maze[X][Y] |= FLAGI;        // To high or low
+   // Final park point
+   if (p->parkvertical)
+   {
+      for (N = 0; N < abs_helix + 2; N++)       // Down to final
+      {
+         maze[0][N] |= FLAGU + FLAGD;
+         maze[X = 0][Y = N + 1] |= FLAGD;
+      }
+      if (!p->inside && !p->noa && W / nubs > 2 && H > abs_helix + 4)
+      {                         // An "A" at finish
+         maze[X][Y] |= FLAGD | FLAGU | FLAGR;
+         maze[X][Y + 1] |= FLAGD | FLAGR;
+         maze[X + 1][Y] |= FLAGD | FLAGU | FLAGL;
+         maze[X + 1][Y + 1] |= FLAGD | FLAGL;
+         maze[X + 1][Y - 1] |= FLAGU;
+         X++;
+         Y--;
+      }
+   } else                       // Left to final
+   {
+      if (helix < 0)
+      {                         // Negative helix: dy<0, so col seg-1 is physically lowest.
+         //   col 0 row abs_helix+1 sits exactly at the FLAGI boundary (not caught by
+         //   strict < check) — mark it FLAGI explicitly to remove that isolated cell.
+         //   Park at col seg-1 row abs_helix+2 (lowest reachable). A extends left.
+         int seg = W / nubs;
+         maze[0][abs_helix + 1] |= FLAGI;       // eliminate isolated below-park cell
+         maze[seg - 1][abs_helix + 2] |= FLAGL; // park: connects left into F
+         maze[X = seg - 2][Y = abs_helix + 2] |= FLAGR; // F(seg-2): right=park
+         if (!p->inside && !p->noa && seg > 3 && H > abs_helix + 4)
+         {                      // An "A" at finish: horizontally mirrored vs. positive helix
+            maze[X][Y] |= FLAGR | FLAGL | FLAGU;        // F(seg-2): right=park, left=E, up=B
+            maze[X - 1][Y] |= FLAGR | FLAGU;    // E(seg-3): right=F, up=A  (dead end)
+            maze[X - 1][Y + 1] |= FLAGR | FLAGD;        // A(seg-3): right=B, down=E  (dead end)
+            maze[X][Y + 1] |= FLAGR | FLAGL | FLAGD;    // B(seg-2): right=C, left=A, down=F
+            maze[X + 1][Y + 1] |= FLAGL;        // C(seg-1): left=B — DFS continues up
+            X++;
+            Y++;
+         }
+      } else
+      {
+         maze[0][abs_helix + 1] |= FLAGR;
+         maze[X = 1][Y = abs_helix + 1] |= FLAGL;
+         if (!p->inside && !p->noa && W / nubs > 3 && H > abs_helix + 3)
+         {                      // An "A" at finish
+            maze[X][Y] |= FLAGL | FLAGR | FLAGU;
+            maze[X + 1][Y] |= FLAGL | FLAGU;
+            maze[X + 1][Y + 1] |= FLAGL | FLAGD;
+            maze[X][Y + 1] |= FLAGL | FLAGR | FLAGD;
+            maze[X - 1][Y + 1] |= FLAGR;
+            X--;
+            Y++;
+         }
+      }
+   }
+   // Make maze
+   int maxx = 0;
+   if (p->testmaze)
+   {                            // Simple test pattern
+      for (Y = 0; Y < H; Y++)
+         for (X = 0; X < W; X++)
+            if (!(test (X, Y) & FLAGI) && !(test (X + 1, Y) & FLAGI))
+            {
+               maze[X][Y] |= FLAGR;
+               int x = X + 1,
+                  y = Y;
+               if (x >= W)
+               {
+                  x -= W;
+                  y += helix;
+               }
+               maze[x][y] |= FLAGL;
+            }
+      if (!p->exitnub)
+         while (maxx + 1 < W && !(test (maxx + 1, H - 2) & FLAGI))
+            maxx++;
+   } else
+   {                            // Actual maze
+      int max = 0;
+      // Busy cells, a bit plane, set where test() is not 0, rows of words of bits. With no helix, one nub, or a helix of a row
+      // a nub, each cell's nub copies in test() go back round to it, so they are all one bit, the plane folded to one nub's
+      // segment, and for column x (-1 to W) col[] is its bit and row[] what to add to y for its row - so each way to go is one
+      // look up, and use() sets one bit. Otherwise (a helix of two rows a nub) the plane has all W columns.
+      int fold = (nubs == 1 || !helix || abs_helix == nubs),
+         S = (fold ? W / nubs : W),
+         words = (S + 63) / 64,
+         low = 0,
+         high = 0;
+      int *col = malloc (sizeof (*col) * (W + 2) * 2),
+         *row = col + W + 2;
+      if (!col)
+      {
+         warnx ("malloc");
+         return 1;
+      }
+      for (int x = -1; x <= W; x++)
+      {
+         int c = x,
+            d = 0;
+         if (c < 0)
+         {
+            c += W;
+            d -= helix;
+         } else if (c >= W)
+         {
+            c -= W;
+            d += helix;
+         }
+         if (fold)
+         {                      // The copy in the first segment, as pb_maze_test goes round
+            if (abs_helix == nubs)
+               d += (helix > 0 ? 1 : -1) * (c / S);
+            c %= S;
+         }
+         col[x + 1] = c;
+         row[x + 1] = d;
+         if (d < low)
+            low = d;
+         if (d > high)
+            high = d;
+      }
+      for (int x = 0; x < W + 2; x++)
+         row[x] += 1 - low;     // Rows from y = low - 1, so y one off either side and the row change are in the plane
+      int rows = H + 2 + high - low;
+      pb_bits_t *busy = calloc (rows * words, sizeof (*busy));
+      if (!busy)
+      {
+         warnx ("malloc");
+         free (col);
+         return 1;
+      }
+      for (int r = 0; r < rows; r++)
+         for (int x = 0; x < S; x++)
+            if (test (x, r + low - 1))
+               busy[r * words + x / 64] |= 1ULL << (x % 64);
+      unsigned long long probes = 0,    // Counts for pb_stats, kept here while making the maze
+         steps = 0,
+         deadends = 0;
+      inline int used (int x, int y)
+      {                         // As test (x, y) != 0, for x one off either side at most
+         probes++;
+         int c = col[x + 1];
+         return (busy[(y + row[x + 1]) * words + c / 64] >> (c % 64)) & 1;
+      }
+      void use (int x, int y)
+      {                         // Cell x/y is now set, so each cell with it as a nub copy in test() is busy
+         if (fold)
+         {                      // All one bit
+            int c = col[x + 1];
+            busy[(y + row[x + 1]) * words + c / 64] |= 1ULL << (c % 64);
+            return;
+         }
+         for (int n = nubs; n--;)
+         {                      // Back round the copies
+            if (y >= 0 && y < H)
+               busy[(y + 1 - low) * words + x / 64] |= 1ULL << (x % 64);
+            x -= W / nubs;
+            if (x < 0)
+            {
+               x += W;
+               y -= helix;
+            }
+         }
+      }
+      typedef struct pos_s pos_t;
+      struct pos_s
+      {
+         int x,
+           y,
+           n,                   // Path length
+           v;                   // Vertical run to here
+      };
+      // Points to consider, a ring so points can be added at start or end - each step pops the current point and pushes it back
+      // with the new cell, so the length is at most 1 + steps, and there is at most one step per cell, hence W * H + 1 is enough
+      int qmax = W * H + 1,
+         qhead = 0,
+         qlen = 1,
+         peak = 1;
+      pos_t *queue = malloc (sizeof (*queue) * qmax);
+      if (!queue)
+      {
+         warnx ("malloc");
+         free (busy);
+         free (col);
+         return 1;
+      }
+      queue[0].x = X;
+      queue[0].y = Y;
+      queue[0].n = 0;
+      queue[0].v = (p->parkvertical ? abs_helix + 2 : 0);
+      use (X, Y);
+      while (qlen)
+      {
+         pos_t *q = queue + qhead;
+         if (++qhead == qmax)
+            qhead = 0;
+         qlen--;
+         // Where we are
+         X = q->x;
+         Y = q->y;
+         int v,
+           n = 0,
+           vok = (!p->maxvertical || q->v < p->maxvertical);    // Can go up or down
+         // Which way can we go
+         // Some bias for direction
+         if (!used (X + 1, Y))
+            n += BIASR;         // Right
+         if (!used (X - 1, Y))
+            n += BIASL;         // Left
+         if (vok && !used (X, Y - 1))
+            n += BIASD;         // Down
+         if (vok && !used (X, Y + 1))
+            n += BIASU;         // Up
+         if (!n)
+            continue;           // No way forward
+         // Pick one of the ways randomly
+         v = pb_rng_range (rng, n);
+         // Move forward
+         if (!used (X + 1, Y) && (v -= BIASR) < 0)
+         {                      // Right
+            maze[X][Y] |= FLAGR;
+            X++;
+            if (X >= W)
+            {
+               X -= W;
+               Y += helix;
+            }
+            maze[X][Y] |= FLAGL;
+         } else if (!used (X - 1, Y) && (v -= BIASL) < 0)
+         {                      // Left
+            maze[X][Y] |= FLAGL;
+            X--;
+            if (X < 0)
+            {
+               X += W;
+               Y -= helix;
+            }
+            maze[X][Y] |= FLAGR;
+         } else if (vok && !used (X, Y - 1) && (v -= BIASD) < 0)
+         {                      // Down
+            maze[X][Y] |= FLAGD;
+            Y--;
+            maze[X][Y] |= FLAGU;
+         } else if (vok && !used (X, Y + 1) && (v -= BIASU) < 0)
+         {                      // Up
+            maze[X][Y] |= FLAGU;
+            Y++;
+            maze[X][Y] |= FLAGD;
+         } else
+         {                      // We should have picked a way we can go
+            warnx ("Maze generation found no way on");
+            free (queue);
+            free (busy);
+            free (col);
+            return 1;
+         }
+         use (X, Y);
+         steps++;
+         // Entry
+         if (q->n > max && (test (X, Y + 1) & FLAGI)    //
+             && (!p->exitnub || !(X % (W / nubs))))
+         {                      // Longest path that reaches top
+            max = q->n;
+            maxx = X;
+            m->exit_y = Y;      // Record exit Y (cell below FLAGI boundary)
+         }
+         // Next point to consider
+         pos_t next = { X, Y, q->n + 1, X == q->x ? q->v + 1 : 0 },
+            this = *q;
+         // How to add points to queue... start or end
+         v = pb_rng_range (rng, 10);
+         if (v < (p->complexity < 0 ? -p->complexity : p->complexity) || max + 2 < p->minsolution)
+         {                      // add next point at start - makes for longer path
+            if (!qhead--)
+               qhead = qmax - 1;
+            queue[qhead] = next;
+         } else                 // add next point at end - makes for multiple paths, which can mean very simple solution
+            queue[(qhead + qlen) % qmax] = next;
+         qlen++;
+         if (p->complexity <= 0 && v < -p->complexity)
+         {                      // current point to start
+            if (!qhead--)
+               qhead = qmax - 1;
+            queue[qhead] = this;
+         } else
+            queue[(qhead + qlen) % qmax] = this;
+         qlen++;
+         if (qlen > peak)
+            peak = qlen;
+      }
+      free (queue);
+      free (busy);
+      free (col);
+      for (int x = 0; x < W; x++)
+         for (int y = 0; y < H; y++)
+         {                      // Dead ends, the cells with one way in or out
+            unsigned char v = maze[x][y] & FLAGA;
+            if (!(maze[x][y] & FLAGI) && v && !(v & (v - 1)))
+               deadends++;
+         }
+      m->path = max;
+      pb_counts.probes += probes;
+      pb_counts.steps += steps;
+      pb_counts.deadends += deadends;
+      if (peak > pb_counts.frontier)
+         pb_counts.frontier = peak;
+   }
+   m->exit_x = maxx;
+   pb_counts.mazes++;
+   // Entry point for maze
+   for (X = maxx % (W / nubs); X < W; X += W / nubs)
+   {
+      Y = H - 1;
+      while (Y && (maze[X][Y] & FLAGI))
+         maze[X][Y--] |= FLAGU + FLAGD;
+      maze[X][Y] += FLAGU;
+   }
+   return 0;
+}
+
+/**
+ * Steps from a cell through a passage, allowing for the wrap around (and helix).
+ *
+ * @param m Maze
+ * @param x X coordinate, updated
+ * @param y Y coordinate, updated
+ * @param d Direction (FLAGL, FLAGR, FLAGU or FLAGD)
+ * @return 1 if there is a passage to a valid cell
+ */
+static int
+pb_maze_step (const pb_maze_t * m, int *x, int *y, int d)
+{
+   int X = *x,
+      Y = *y;
+   if (!(m->maze[X * m->H + Y] & d))
+      return 0;
+   if (d == FLAGR && ++X >= m->W)
+   {
+      X -= m->W;
+      Y += m->helix;
+   } else if (d == FLAGL && --X < 0)
+   {
+      X += m->W;
+      Y -= m->helix;
+   } else if (d == FLAGU)
+      Y++;
+   else if (d == FLAGD)
+      Y--;
+   if (Y < 0 || Y >= m->H || (m->maze[X * m->H + Y] & FLAGI))
+      return 0;
+   *x = X;
+   *y = Y;
+   return 1;
+}
+
+// Bit planes for a maze, rows of words of W bits - the valid cells, and the cells with a passage each way
+typedef struct pb_planes_s pb_planes_t;
+struct pb_planes_s
+{
+   int W,
+     H,
+     words;                     // Words a row
+   pb_bits_t *ok,               // Not FLAGI
+    *l,                         // FLAGL, FLAGR, FLAGU and FLAGD
+    *r,
+    *u,
+    *d;
+};
+
+/**
+ * Makes the bit planes for a maze.
+ *
+ * @param b Planes, free b->ok when done
+ * @param m Maze
+ * @return 0 on success, 1 on error
+ */
+static int
+pb_planes_make (pb_planes_t * b, const pb_maze_t * m)
+{
+   int W = m->W,
+      H = m->H,
+      w = (W + 63) / 64;
+   b->W = W;
+   b->H = H;
+   b->words = w;
+   if (!(b->ok = calloc (5 * H * w, sizeof (*b->ok))))
+   {
+      warnx ("malloc");
+      return 1;
+   }
+   b->l = b->ok + H * w;
+   b->r = b->l + H * w;
+   b->u = b->r + H * w;
+   b->d = b->u + H * w;
+   const unsigned char *v = m->maze;
+   for (int x = 0; x < W; x++)
+   {
+      int s = x % 64;
+      pb_bits_t *ok = b->ok + x / 64,
+         *l = b->l + x / 64,
+         *r = b->r + x / 64,
+         *u = b->u + x / 64,
+         *d = b->d + x / 64;
+      for (int y = 0; y < H; y++, v++)
+      {                         // A bit from each flag
+         ok[y * w] |= (pb_bits_t) (~*v >> 7 & 1) << s;
+         l[y * w] |= (pb_bits_t) (*v & 1) << s;
+         r[y * w] |= (pb_bits_t) (*v >> 1 & 1) << s;
+         u[y * w] |= (pb_bits_t) (*v >> 2 & 1) << s;
+         d[y * w] |= (pb_bits_t) (*v >> 3 & 1) << s;
+      }
+   }
+   return 0;
+}
+
+/**
+ * Finds the way from the park point to the exit (only the "A" has a loop) - fills the cells that can be reached as
+ * bit planes, a row of words at a time, sweeping up the rows and then down until no more are reached. In each row it
+ * spreads left and right as far as it can, and then on to the rows above (or below) and round the seam. Each cell is
+ * added when it is first reached, with the cell it was reached from as its parent, so parents come first.
+ *
+ * @param m Maze
+ * @param parent Set to the previous cell for each cell reached, -1 at the park point, or NULL
+ * @param queue Set to the cells reached, in the order they were reached, W * H, or NULL
+ * @param mark Set non zero for each cell reached, W * H and zero
+ * @param all Reach every cell that can be reached, else stop at the exit
+ * @return Cells reached, 0 if the park point is not valid (or no exit is set, unless all), -1 on error
+ */
+static int
+pb_maze_route (const pb_maze_t * m, int *parent, int *queue, unsigned char *mark, int all)
+{
+   int W = m->W,
+      H = m->H,
+      helix = m->helix,
+      abs_helix = helix < 0 ? -helix : helix;
+   // Park point, as the maze visualization
+   if (m->nubs < 1)
+   {
+      warnx ("Maze has no nubs set");
+      return 0;
+   }
+   int sx = (helix < 0 ? W / m->nubs - 1 : 0),
+      sy = abs_helix + (helix < 0 ? 2 : 1),
+      ex = m->exit_x,
+      ey = m->exit_y;
+   if (sy >= H || (!all && ey < 0) || (m->maze[sx * H + sy] & FLAGI))
+      return 0;
+   pb_planes_t b;
+   if (pb_planes_make (&b, m))
+      return -1;
+   int w = b.words,
+      e = (W - 1) / 64;         // Word with the last column
+   pb_bits_t last = 1ULL << ((W - 1) % 64),
+      *seen = calloc (H * w, sizeof (*seen));
+   if (!seen)
+   {
+      warnx ("malloc");
+      free (b.ok);
+      return -1;
+   }
+   int reached = 0,
+      done = 0;
+   void add (int y, int i, pb_bits_t v, int dx, int dy)
+   {                            // New cells in word i of row y, from the cell dx/dy away
+      seen[y * w + i] |= v;
+      for (; v; v &= v - 1)
+      {
+         int x = i * 64 + __builtin_ctzll (v),
+            c = x * H + y;
+         mark[c] = 1;
+         if (queue)
+            queue[reached] = c;
+         reached++;
+         if (parent)
+         {
+            int px = x + dx,
+               py = y + dy;
+            if (px < 0)
+            {
+               px += W;
+               py -= helix;
+            } else if (px >= W)
+            {
+               px -= W;
+               py += helix;
+            }
+            parent[c] = (dx || dy ? px * H + py : -1);
+         }
+      }
+      if (!all && mark[ex * H + ey])
+         done = 1;
+   }
+   int spread (int y)
+   {                            // Along row y as far as it goes, and round the seam, returns if any new
+      pb_bits_t *s = seen + y * w,
+         *ok = b.ok + y * w,
+         *l = b.l + y * w,
+         *r = b.r + y * w;
+      int any = 0,
+         more = 1;
+      while (more && !done)
+      {
+         more = 0;
+         pb_bits_t carry = 0;
+         for (int i = 0; i < w; i++)
+         {                      // Right
+            pb_bits_t g = s[i] & r[i],
+               v = ((g << 1) | carry) & ok[i] & ~s[i];
+            carry = g >> 63;
+            if (v)
+            {
+               add (y, i, v, -1, 0);
+               more = 1;
+            }
+         }
+         for (int i = 0; i < w; i++)
+         {                      // Left
+            pb_bits_t v = ((s[i] & l[i]) >> 1 | (i + 1 < w ? (s[i + 1] & l[i + 1]) << 63 : 0)) & ok[i] & ~s[i];
+            if (v)
+            {
+               add (y, i, v, 1, 0);
+               more = 1;
+            }
+         }
+         any |= more;
+      }
+      int t = y + helix;
+      if ((s[e] & r[e] & last) && t >= 0 && t < H && (b.ok[t * w] & ~seen[t * w] & 1))
+      {                         // Round the seam to the first column helix up
+         add (t, 0, 1, -1, 0);
+         any = 1;
+      }
+      t = y - helix;
+      if ((s[0] & l[0] & 1) && t >= 0 && t < H && (b.ok[t * w + e] & ~seen[t * w + e] & last))
+      {                         // Round the seam to the last column helix down
+         add (t, e, last, 1, 0);
+         any = 1;
+      }
+      return any;
+   }
+   int climb (int y, int d, const pb_bits_t * p)
+   {                            // From row y to row y + d, through the passages in p, returns if any new
+      int any = 0;
+      for (int i = 0; i < w; i++)
+      {
+         pb_bits_t v = seen[y * w + i] & p[y * w + i] & b.ok[(y + d) * w + i] & ~seen[(y + d) * w + i];
+         if (v)
+         {
+            add (y + d, i, v, 0, -d);
+            any = 1;
+         }
+      }
+      return any;
+   }
+   add (sy, sx / 64, 1ULL << (sx % 64), 0, 0);
+   int more = 1;
+   while (more && !done)
+   {
+      more = 0;
+      for (int y = 0; y < H && !done; y++)
+      {                         // Up
+         more |= spread (y);
+         if (y + 1 < H)
+            more |= climb (y, 1, b.u);
+      }
+      for (int y = H; y-- && !done;)
+      {                         // Down
+         more |= spread (y);
+         if (y)
+            more |= climb (y, -1, b.d);
+      }
+   }
+   free (seen);
+   free (b.ok);
+   return reached;
+}
+
+/**
+ * Finds the solution, the cells from the park point to the exit
+ *
+ * @param m Maze
+ * @param path Set to the cells, x*H+y, park point first, room for W * H, or NULL just to count
+ * @return Cells on the solution, 0 if there is none, -1 on error
+ */
+int
+pb_maze_solve (const pb_maze_t * m, int *path)
+{
+   int W = m->W,
+      H = m->H;
+   int *parent = malloc (sizeof (*parent) * W * H);
+   unsigned char *mark = calloc (1, W * H);
+   int n = 0,
+      r = 0;
+   if (!parent || !mark)
+   {
+      warnx ("malloc");
+      n = -1;
+   } else if ((r = pb_maze_route (m, parent, NULL, mark, 0)) < 0)
+      n = -1;
+   else if (r && mark[m->exit_x * H + m->exit_y])
+   {
+      for (int c = m->exit_x * H + m->exit_y; c >= 0; c = parent[c])
+         n++;
+      if (path)
+      {
+         int i = n;
+         for (int c = m->exit_x * H + m->exit_y; c >= 0; c = parent[c])
+            path[--i] = c;
+      }
+   }
+   free (parent);
+   free (mark);
+   return n;
+}
+
+/**
+ * Finds the cells that can be reached from the park point
+ *
+ * @param m Maze
+ * @param reached Set non zero for each cell reached, W * H and zero
+ * @return Cells reached, 0 if the park point is not valid, -1 on error
+ */
+int
+pb_maze_reach (const pb_maze_t * m, unsigned char *reached)
+{
+   return pb_maze_route (m, NULL, NULL, reached, 1);
+}
+
+/**
+ * Scores a maze (see scoring.md) - finds the solution from the park point to the exit, and
+ * the traps (dead end branches) off it. Linear: every cell is reached from the park point (a fill
+ * of the bit planes), which makes a tree, and each cell's subtree size is added up in reverse order, so
+ * a trap's size is that of its branch off the solution. Branches joined by a passage not in the
+ * tree (the "A") are one trap.
+ *
+ * score = solution + choices + trapcells / 2 - 2 * smalltraps - 10 * downtraps
+ *         - 5 * (vertical - PB_VERTICAL_MAX if more)
+ *
+ * @param m Maze
+ * @param s Score
+ * @return 0 on success, 1 if no solution, -1 on error
+ */
+int
+pb_maze_score (const pb_maze_t * m, pb_score_t * s)
+{
+   static const int dirs[4] = { FLAGL, FLAGR, FLAGU, FLAGD };
+   int W = m->W,
+      H = m->H,
+      ex = m->exit_x,
+      ey = m->exit_y;
+   memset (s, 0, sizeof (*s));
+   int *parent = malloc (sizeof (*parent) * W * H),
+      *queue = malloc (sizeof (*queue) * W * H),
+      *size = malloc (sizeof (*size) * W * H),
+      *trap = malloc (sizeof (*trap) * W * H);
+   unsigned char *mark = calloc (1, W * H);
+   int e = 0,
+      n = 0;
+   if (!parent || !queue || !size || !trap || !mark)
+   {
+      warnx ("malloc");
+      e = -1;
+   } else if ((n = pb_maze_route (m, parent, queue, mark, 1)) < 0)
+      e = -1;
+   else if (!n || ey < 0 || !mark[ex * H + ey])
+      e = 1;
+   if (e)
+   {
+      free (parent);
+      free (queue);
+      free (size);
+      free (trap);
+      free (mark);
+      return e;
+   }
+   // Subtree sizes, leaves first
+   for (int i = 0; i < n; i++)
+      size[queue[i]] = 1;
+   for (int i = n - 1; i > 0; i--)
+      size[parent[queue[i]]] += size[queue[i]];
+   // Mark the solution (2), and the longest vertical run on it
+   int run = 0;
+   for (int c = ex * H + ey; c >= 0; c = parent[c])
+   {
+      mark[c] = 2;
+      s->solution++;
+      int p = parent[c];
+      if (p >= 0 && p / H == c / H)
+      {
+         if (++run > s->vertical)
+            s->vertical = run;
+      } else
+         run = 0;
+   }
+   // Which trap each cell off the solution is in - the branch it is on, or one it is joined to
+   int find (int c)
+   {
+      while (trap[c] != c)
+         c = trap[c] = trap[trap[c]];
+      return c;
+   }
+   for (int i = 1; i < n; i++)
+   {
+      int c = queue[i];
+      if (mark[c] != 2)
+         trap[c] = (mark[parent[c]] == 2 ? c : trap[parent[c]]);
+   }
+   for (int i = 1; i < n; i++)
+   {
+      int c = queue[i];
+      if (mark[c] == 2)
+         continue;
+      for (int d = 0; d < 4; d++)
+      {
+         int x = c / H,
+            y = c % H;
+         if (!pb_maze_step (m, &x, &y, dirs[d]))
+            continue;
+         int t = x * H + y;
+         if (mark[t] == 2 || parent[t] == c || parent[c] == t)
+            continue;
+         int a = find (c),
+            b = find (t);
+         if (a != b)
+         {                      // Joined
+            trap[a] = b;
+            size[b] += size[a];
+         }
+      }
+   }
+   // Traps - the branches off each solution cell, and the turns
+   for (int c = ex * H + ey, next = -1; c >= 0; next = c, c = parent[c])
+   {
+      int choice = 0,
+         in = 0,
+         out = 0;
+      for (int d = 0; d < 4; d++)
+      {
+         int x = c / H,
+            y = c % H;
+         if (!pb_maze_step (m, &x, &y, dirs[d]))
+            continue;
+         int t = x * H + y;
+         if (t == parent[c])
+            in = dirs[d];
+         else if (t == next)
+            out = dirs[d];
+         if (mark[t] == 2 || mark[t = find (t)] == 3)
+            continue;
+         // Trap
+         mark[t] = 3;
+         choice = 1;
+         s->traps++;
+         if (dirs[d] == FLAGD)
+            s->downtraps++;
+         if (size[t] >= PB_TRAP_MIN)
+            s->trapcells += size[t];
+         else
+            s->smalltraps++;
+         if (size[t] > s->maxtrap)
+            s->maxtrap = size[t];
+      }
+      s->choices += choice;
+      if (choice && in && out && (in | out) != (FLAGL | FLAGR) && (in | out) != (FLAGU | FLAGD))
+         s->turns++;            // Turn that is not at a corner
+   }
+   free (parent);
+   free (queue);
+   free (size);
+   free (trap);
+   free (mark);
+   s->score = s->solution + s->choices + s->trapcells / 2.0 - 2 * s->smalltraps - 10 * s->downtraps;
+   if (s->vertical > PB_VERTICAL_MAX)
+      s->score -= 5 * (s->vertical - PB_VERTICAL_MAX);
+   return 0;
+}
+
+/**
+ * Checks a maze's score meets the targets in the params.
+ *
+ * @param p What was made, with the targets
+ * @param s Score
+ * @return 1 if it meets them (or there are none)
+ */
+int
+pb_maze_targets (const pb_params_t * p, const pb_score_t * s)
+{
+   return s->solution >= p->minsolution && (!p->maxvertical || s->vertical <= p->maxvertical) && s->choices >= p->minchoices;
+}
+
+// Candidate search
+typedef struct pb_cand_s pb_cand_t;
+struct pb_cand_s
+{
+   int c;                       // Candidate number, which is also its random stream
+   int ok;                      // Meets the targets
+   pb_score_t score;
+   pb_maze_t maze;
+};
+
+typedef struct pb_search_s pb_search_t;
+struct pb_search_s
+{
+   const pb_params_t *p;
+   unsigned long long stream;
+   int n,                       // Candidates
+     k;                         // To keep
+   int next;                    // Next candidate to make (atomic)
+   int fail;                    // A candidate could not be made
+};
+
+typedef struct pb_worker_s pb_worker_t;
+struct pb_worker_s
+{
+   pthread_t thread;
+   pb_search_t *s;
+   unsigned char *cells;        // k+1 mazes
+   unsigned char *spare;        // The one of them no kept candidate uses, for the next - kept across sets
+   pb_cand_t *kept;             // k, best first
+   int nkept;
+};
+
+/**
+ * Checks if one candidate is better than another - meeting the targets, then by score, then by candidate number
+ * so the result does not depend on how candidates were shared between threads.
+ */
+static int
+pb_cand_better (const pb_cand_t * a, const pb_cand_t * b)
+{
+   return a->ok > b->ok || (a->ok == b->ok
+                            && (a->score.score > b->score.score || (a->score.score == b->score.score && a->c < b->c)));
+}
+
+static int
+pb_cand_cmp (const void *a, const void *b)
+{
+   return pb_cand_better (a, b) ? -1 : pb_cand_better (b, a) ? 1 : 0;
+}
+
+/**
+ * Search thread - takes candidates from the shared counter until all are made, keeping its own best k.
+ */
+static void *
+pb_search_worker (void *arg)
+{
+   pb_worker_t *w = arg;
+   pb_search_t *s = w->s;
+   size_t size = s->p->W * s->p->H;
+   unsigned char *spare = w->spare;
+   int c;
+   while ((c = __atomic_fetch_add (&s->next, 1, __ATOMIC_RELAXED)) < s->n)
+   {
+      pb_rng_t rng;
+      pb_cand_t t = {.c = c };
+      pb_rng_seed (&rng, s->stream ^ (c + 1) * 0xD1B54A32D192ED03ULL);
+      t.maze.maze = spare;
+      if (pb_maze_generate (&t.maze, s->p, &rng))
+      {
+         __atomic_store_n (&s->fail, 1, __ATOMIC_RELAXED);
+         break;
+      }
+      int e = pb_maze_score (&t.maze, &t.score);
+      if (e < 0)
+      {
+         __atomic_store_n (&s->fail, 1, __ATOMIC_RELAXED);
+         break;
+      }
+      if (e)
+         t.score.score = -1e9;  // No solution
+      else
+         t.ok = pb_maze_targets (s->p, &t.score);
+      if (w->nkept == s->k && !pb_cand_better (&t, &w->kept[s->k - 1]))
+         continue;              // Not good enough, spare is used again
+      int i = w->nkept;
+      if (w->nkept < s->k)
+         spare = w->cells + ++w->nkept * size;  // Next unused
+      else
+         spare = w->kept[--i].maze.maze;        // Worst is dropped
+      while (i && pb_cand_better (&t, &w->kept[i - 1]))
+      {
+         w->kept[i] = w->kept[i - 1];
+         i--;
+      }
+      w->kept[i] = t;
+   }
+   w->spare = spare;
+   pb_stats_flush ();
+   return NULL;
+}
+
+/**
+ * Makes candidate mazes and keeps the best by pb_maze_score. Each candidate has its own random
+ * stream (from stream and the candidate number), so the result is the same for any number of threads.
+ * With targets (see pb_params_t), those that meet them are best, and if none of a set of candidates do,
+ * another set is made, up to PB_TARGET_TRIES sets - see pb_maze_targets for if the best met them.
+ *
+ * @param p What to make
+ * @param stream Seed for the candidate streams
+ * @param candidates Mazes to make
+ * @param threads Threads to use, 0 for one per core
+ * @param keep Best mazes to keep
+ * @param top Best mazes, best first - maze is used if set (W*H cells), else allocated
+ * @param tops Their scores
+ * @return Number kept (up to keep), -1 on error
+ */
+int
+pb_maze_search (const pb_params_t * p, unsigned long long stream, int candidates, int threads, int keep, pb_maze_t * top,
+                pb_score_t * tops)
+{
+   if (candidates < 1 || keep < 1)
+      return 0;
+   if (keep > candidates)
+      keep = candidates;
+   if (threads < 1)
+      threads = sysconf (_SC_NPROCESSORS_ONLN);
+   if (threads < 1)
+      threads = 1;
+   if (threads > candidates)
+      threads = candidates;
+   size_t size = p->W * p->H;
+   pb_search_t s = {.p = p,.stream = stream,.n = candidates,.k = keep };
+   pb_worker_t *w = calloc (threads, sizeof (*w));
+   if (!w)
+   {
+      warnx ("malloc");
+      return -1;
+   }
+   for (int t = 0; t < threads && !s.fail; t++)
+   {
+      w[t].s = &s;
+      if (!(w[t].cells = malloc ((keep + 1) * size)) || !(w[t].kept = malloc (keep * sizeof (*w[t].kept))))
+      {
+         warnx ("malloc");
+         s.fail = 1;
+      }
+      w[t].spare = w[t].cells;
+   }
+   int targets = (p->minsolution || p->maxvertical || p->minchoices),
+      tries;
+   for (tries = 0; tries < (targets ? PB_TARGET_TRIES : 1) && !s.fail; tries++)
+   {                            // Whole sets, so which are made does not depend on the threads
+      s.next = tries * candidates;
+      s.n = (tries + 1) * candidates;
+      // The first thread is this one, and if a thread cannot be started those that are make its candidates
+      int run;
+      for (run = 1; run < threads && !pthread_create (&w[run].thread, NULL, pb_search_worker, &w[run]); run++);
+      pb_search_worker (&w[0]);
+      for (int t = 1; t < run; t++)
+         pthread_join (w[t].thread, NULL);
+      int t;
+      for (t = 0; t < threads && !(w[t].nkept && w[t].kept[0].ok); t++);
+      if (t < threads)
+         break;                 // Met
+   }
+   // Merge
+   int n = 0;
+   pb_cand_t *all = (s.fail ? NULL : malloc (threads * keep * sizeof (*all)));
+   if (!s.fail && !all)
+   {
+      warnx ("malloc");
+      s.fail = 1;
+   }
+   for (int t = 0; t < threads && all; t++)
+      for (int i = 0; i < w[t].nkept; i++)
+         all[n++] = w[t].kept[i];
+   if (all)
+      qsort (all, n, sizeof (*all), pb_cand_cmp);
+   if (n > keep)
+      n = keep;
+   for (int i = 0; i < n && !s.fail; i++)
+   {
+      unsigned char *maze = top[i].maze;
+      int allocated = top[i].allocated;
+      if (!maze)
+      {
+         if (!(maze = malloc (size)))
+         {
+            warnx ("malloc");
+            s.fail = 1;
+            break;
+         }
+         allocated = 1;
+      }
+      memcpy (maze, all[i].maze.maze, size);
+      top[i] = all[i].maze;
+      top[i].maze = maze;
+      top[i].allocated = allocated;
+      tops[i] = all[i].score;
+      pb_score_t check;
+      if (tries && (pb_maze_score (&top[i], &check) || check.score != tops[i].score))
+      {                         // Kept over more than one set, so check it is still the maze that was scored
+         warnx ("Maze search kept a maze that does not match its score");
+         s.fail = 1;
+      }
+   }
+   free (all);
+   for (int t = 0; t < threads; t++)
+   {
+      free (w[t].cells);
+      free (w[t].kept);
+   }
+   free (w);
+   return s.fail ? -1 : n;
+}
+
+/**
+ * Frees the maze cells if allocated by pb_maze_generate or pb_maze_load.
+ *
+ * @param m Maze
+ */
+void
+pb_maze_free (pb_maze_t * m)
+{
+   if (m->allocated)
+      free (m->maze);
+   m->maze = NULL;
+   m->allocated = 0;
+}
+
+/**
+ * Writes a maze in human-readable text format (as saved to a maze file).
+ * Format:
+ *   PUZZLEBOX_MAZE v1.1
+ *   WIDTH <W>
+ *   HEIGHT <H>
+ *   HELIX <helix>
+ *   EXIT_X <X>
+ *   DATA
+ *   <hex bytes, one row per line>
+ *   END
+ *
+ * @param m Maze
+ * @param sink Called with each line in turn
+ * @param ctx Passed to sink
+ */
+void
+pb_maze_write (const pb_maze_t * m, pb_sink_t * sink, void *ctx)
+{
+   char line[40];
+   sink (ctx, "PUZZLEBOX_MAZE v1.1\n");
+   sprintf (line, "WIDTH %d\n", m->W);
+   sink (ctx, line);
+   sprintf (line, "HEIGHT %d\n", m->H);
+   sink (ctx, line);
+   sprintf (line, "HELIX %d\n", m->helix);
+   sink (ctx, line);
+   sprintf (line, "EXIT_X %d\n", m->exit_x);
+   sink (ctx, line);
+   sink (ctx, "DATA\n");
+   // Maze data as hex, one row per line, a row at a time where it fits in line
+   for (int y = 0; y < m->H; y++)
+   {
+      char *o = line;
+      for (int x = 0; x < m->W; x++)
+      {
+         if (o - line > (int) sizeof (line) - 5)
+         {
+            sink (ctx, line);
+            o = line;
+         }
+         o += sprintf (o, x < m->W - 1 ? "%02X " : "%02X\n", m->maze[x * m->H + y]);
+      }
+      sink (ctx, line);
+   }
+   sink (ctx, "END\n");
+}
+
+static void
+file_sink (void *ctx, const char *text)
+{
+   fputs (text, ctx);
+}
+
+/**
+ * Loads a maze in human-readable text format (see pb_maze_write).
+ * Version 1.0 files have no HELIX, and EXIT_X is optional (or legacy ENTRY_X).
+ * No version has the nubs, so m->nubs is left as set by the caller, or the exit row, which is the top cell
+ * of the exit column that is in the maze.
+ *
+ * @param filename Path to input file, for errors
+ * @param f Open file, which is closed
+ * @param m Maze to load, m->maze is used if set (expected_W*expected_H cells), else allocated
+ * @param expected_W Expected width (0 to accept any width)
+ * @param expected_H Expected height (0 to accept any height)
+ * @return 0 on success, 1 on error
+ */
+static int
+pb_maze_load_text (const char *filename, FILE * f, pb_maze_t * m, int expected_W, int expected_H)
+{
+   char line[16384];
+   int W = 0,
+      H = 0,
+      X = 0,
+      helix = 0;
+   int file_version = 0;        // 0=v1.0 (no helix), 1=v1.1 (with helix)
+
+   int fail (const char *fmt, ...)
+   {
+      va_list ap;
+      va_start (ap, fmt);
+      vwarnx (fmt, ap);
+      va_end (ap);
+      fclose (f);
+      return 1;
+   }
+
+   // Read and validate header
+   if (!fgets (line, sizeof (line), f))
+      return fail ("Cannot read header from %s", filename);
+   if (strncmp (line, "PUZZLEBOX_MAZE v1.1", 19) == 0)
+      file_version = 1;
+   else if (strncmp (line, "PUZZLEBOX_MAZE v1.0", 19) == 0)
+      file_version = 0;
+   else
+      return fail ("Invalid maze file header in %s", filename);
+
+   // Read WIDTH
+   if (!fgets (line, sizeof (line), f) || sscanf (line, "WIDTH %d", &W) != 1 || W <= 0)
+      return fail ("Invalid or missing WIDTH in %s", filename);
+
+   // Read HEIGHT
+   if (!fgets (line, sizeof (line), f) || sscanf (line, "HEIGHT %d", &H) != 1 || H <= 0)
+      return fail ("Invalid or missing HEIGHT in %s", filename);
+
+   // Read HELIX (only in v1.1)
+   if (file_version >= 1 && (!fgets (line, sizeof (line), f) || sscanf (line, "HELIX %d", &helix) != 1))
+      return fail ("Invalid or missing HELIX in v1.1 file %s", filename);
+
+   // Read EXIT_X (optional for backward compatibility with old ENTRY_X format)
+   if (!fgets (line, sizeof (line), f))
+      return fail ("Unexpected end of file in %s", filename);
+   if (sscanf (line, "EXIT_X %d", &X) == 1 || sscanf (line, "ENTRY_X %d", &X) == 1)
+   {                            // Successfully read EXIT_X (or legacy ENTRY_X), now read the next line which should be DATA
+      if (!fgets (line, sizeof (line), f) || strncmp (line, "DATA", 4) != 0)
+         return fail ("Missing DATA marker in %s", filename);
+   } else if (strncmp (line, "DATA", 4) == 0)
+      X = 0;                    // Old format without EXIT_X/ENTRY_X, this line is DATA marker
+   else
+      return fail ("Expected EXIT_X or DATA marker in %s", filename);
+
+   // Validate dimensions if expected values provided
+   if (expected_W > 0 && W != expected_W)
+      return fail ("Maze width mismatch: expected %d, got %d from %s", expected_W, W, filename);
+   if (expected_H > 0 && H != expected_H)
+      return fail ("Maze height mismatch: expected %d, got %d from %s", expected_H, H, filename);
+
+   unsigned char *maze = m->maze;
+   if (!maze && !(maze = malloc (W * H)))
+      return fail ("malloc");
+
+   // Read maze data (one row per line)
+   for (int y = 0; y < H; y++)
+   {
+      if (!fgets (line, sizeof (line), f))
+      {
+         if (maze != m->maze)
+            free (maze);
+         return fail ("Unexpected end of file reading maze data at row %d in %s", y, filename);
+      }
+      // Parse hex values from this row
+      char *ptr = line;
+      for (int x = 0; x < W; x++)
+      {
+         unsigned int val;
+         if (sscanf (ptr, "%2X", &val) != 1)
+         {
+            if (maze != m->maze)
+               free (maze);
+            return fail ("Invalid hex data at row %d, col %d in %s", y, x, filename);
+         }
+         maze[x * H + y] = (unsigned char) val;
+         // Move pointer past this hex value and any whitespace
+         ptr += 2;
+         while (*ptr == ' ' || *ptr == '\t')
+            ptr++;
+      }
+   }
+
+   // Read END line
+   if (!fgets (line, sizeof (line), f) || strncmp (line, "END", 3) != 0)
+   {
+      if (maze != m->maze)
+         free (maze);
+      return fail ("Missing END marker in %s", filename);
+   }
+
+   fclose (f);
+   if (maze != m->maze)
+   {
+      m->maze = maze;
+      m->allocated = 1;
+   }
+   m->W = W;
+   m->H = H;
+   m->helix = helix;
+   m->exit_x = X;
+   m->exit_y = -1;
+   if (X >= 0 && X < W)
+      for (int y = H - 1; y >= 0 && m->exit_y < 0; y--)
+         if (!(maze[X * H + y] & FLAGI) && (maze[X * H + y] & (FLAGL | FLAGR | FLAGD)))
+            m->exit_y = y;      // Top cell in the maze, below the entry
+   m->path = 0;
+   return 0;
+}
+
+// Binary maze (.pbmz), all little endian
+//   0  "PBMZ"
+//   4  u8 version (1)
+//   5  u8 flags (PBMZ_PACKED, PBMZ_SCORE)
+//   6  u16 W, u16 H, s16 helix, u16 exit_x, s16 exit_y, u16 nubs, u16 path
+//  20  f32 score, u16 solution, u16 traps, u16 downtraps, u16 vertical
+//  32  cells x*H+y, one byte each, or if PBMZ_PACKED a nibble each (low first) for directions then a bit each for FLAGI
+// Collection (.pbmc), for mmap, mazes picked by number or by size
+//   0  "PBMC"
+//   4  u32 version (1), u32 count, u32 reserved
+//  16  index of count entries: u32 offset, u32 size, u16 W, u16 H, s16 helix, u16 reserved, f32 score
+//      followed by each maze as above
+#define	PBMZ_HEADER	32
+#define	PBMZ_PACKED	0x01    // Directions and FLAGI packed
+#define	PBMZ_SCORE	0x02    // Score is set
+#define	PBMC_HEADER	16
+#define	PBMC_ENTRY	20
+
+static void
+put16 (unsigned char *p, int v)
+{
+   p[0] = v;
+   p[1] = v >> 8;
+}
+
+static void
+put32 (unsigned char *p, unsigned int v)
+{
+   put16 (p, v);
+   put16 (p + 2, v >> 16);
+}
+
+static void
+putf (unsigned char *p, float f)
+{
+   unsigned int v;
+   memcpy (&v, &f, sizeof (v));
+   put32 (p, v);
+}
+
+static unsigned int
+get16 (const unsigned char *p)
+{
+   return p[0] | (p[1] << 8);
+}
+
+static int
+gets16 (const unsigned char *p)
+{
+   return (short) get16 (p);
+}
+
+static unsigned int
+get32 (const unsigned char *p)
+{
+   return get16 (p) | (get16 (p + 2) << 16);
+}
+
+static float
+getf (const unsigned char *p)
+{
+   unsigned int v = get32 (p);
+   float f;
+   memcpy (&f, &v, sizeof (f));
+   return f;
+}
+
+/**
+ * Packs a maze in binary format. The grid is packed (5 bits a cell) if there are no other flags.
+ *
+ * @param m Maze
+ * @param s Score (NULL if not known)
+ * @param buf Where to pack (NULL to just get the size)
+ * @return Bytes
+ */
+size_t
+pb_maze_pack (const pb_maze_t * m, const pb_score_t * s, unsigned char *buf)
+{
+   int cells = m->W * m->H,
+      packed = 1;
+   for (int c = 0; c < cells && packed; c++)
+      if (m->maze[c] & ~(FLAGA | FLAGI))
+         packed = 0;
+   size_t len = PBMZ_HEADER + (packed ? (cells + 1) / 2 + (cells + 7) / 8 : cells);
+   if (!buf)
+      return len;
+   memset (buf, 0, len);
+   memcpy (buf, "PBMZ", 4);
+   buf[4] = 1;
+   buf[5] = (packed ? PBMZ_PACKED : 0) | (s ? PBMZ_SCORE : 0);
+   put16 (buf + 6, m->W);
+   put16 (buf + 8, m->H);
+   put16 (buf + 10, m->helix);
+   put16 (buf + 12, m->exit_x);
+   put16 (buf + 14, m->exit_y);
+   put16 (buf + 16, m->nubs);
+   put16 (buf + 18, m->path);
+   if (s)
+   {
+      putf (buf + 20, s->score);
+      put16 (buf + 24, s->solution);
+      put16 (buf + 26, s->traps);
+      put16 (buf + 28, s->downtraps);
+      put16 (buf + 30, s->vertical);
+   }
+   unsigned char *o = buf + PBMZ_HEADER;
+   if (!packed)
+      memcpy (o, m->maze, cells);
+   else
+      for (int c = 0; c < cells; c++)
+      {
+         o[c / 2] |= (m->maze[c] & FLAGA) << ((c & 1) * 4);
+         if (m->maze[c] & FLAGI)
+            o[(cells + 1) / 2 + c / 8] |= 1 << (c & 7);
+      }
+   return len;
+}
+
+/**
+ * Unpacks a maze in binary format (see pb_maze_pack).
+ *
+ * @param data Packed maze
+ * @param len Bytes
+ * @param m Maze to load, m->maze is used if set (expected_W*expected_H cells), else allocated
+ * @param s Score if known, else score is 0 (can be NULL)
+ * @param expected_W Expected width (0 to accept any width)
+ * @param expected_H Expected height (0 to accept any height)
+ * @param name For errors
+ * @return 0 on success, 1 on error
+ */
+int
+pb_maze_unpack (const unsigned char *data, size_t len, pb_maze_t * m, pb_score_t * s, int expected_W, int expected_H,
+                const char *name)
+{
+   if (len < PBMZ_HEADER || memcmp (data, "PBMZ", 4) || data[4] != 1)
+   {
+      warnx ("Invalid binary maze in %s", name);
+      return 1;
+   }
+   int W = get16 (data + 6),
+      H = get16 (data + 8),
+      cells = W * H,
+      packed = (data[5] & PBMZ_PACKED);
+   if (!W || !H || len < PBMZ_HEADER + (packed ? (cells + 1) / 2 + (cells + 7) / 8 : cells))
+   {
+      warnx ("Invalid binary maze in %s", name);
+      return 1;
+   }
+   if (expected_W > 0 && W != expected_W)
+   {
+      warnx ("Maze width mismatch: expected %d, got %d from %s", expected_W, W, name);
+      return 1;
+   }
+   if (expected_H > 0 && H != expected_H)
+   {
+      warnx ("Maze height mismatch: expected %d, got %d from %s", expected_H, H, name);
+      return 1;
+   }
+   if (!m->maze)
+   {
+      if (!(m->maze = malloc (cells)))
+      {
+         warnx ("malloc");
+         return 1;
+      }
+      m->allocated = 1;
+   }
+   const unsigned char *i = data + PBMZ_HEADER;
+   if (!packed)
+      memcpy (m->maze, i, cells);
+   else
+      for (int c = 0; c < cells; c++)
+         m->maze[c] = ((i[c / 2] >> ((c & 1) * 4)) & FLAGA) | ((i[(cells + 1) / 2 + c / 8] & (1 << (c & 7))) ? FLAGI : 0);
+   m->W = W;
+   m->H = H;
+   m->helix = gets16 (data + 10);
+   m->exit_x = get16 (data + 12);
+   m->exit_y = gets16 (data + 14);
+   if (get16 (data + 16))
+      m->nubs = get16 (data + 16);
+   m->path = get16 (data + 18);
+   if (s)
+   {
+      memset (s, 0, sizeof (*s));
+      if (data[5] & PBMZ_SCORE)
+      {
+         s->score = getf (data + 20);
+         s->solution = get16 (data + 24);
+         s->traps = get16 (data + 26);
+         s->downtraps = get16 (data + 28);
+         s->vertical = get16 (data + 30);
+      }
+   }
+   return 0;
+}
+
+/**
+ * Picks a maze from a collection - number n (from 1), or if n is 0 the best scoring of the
+ * expected size (and helix if there is one of that helix).
+ *
+ * @return Index entry, NULL if none
+ */
+static const unsigned char *
+pb_collection_pick (const unsigned char *data, size_t len, int n, int W, int H, int helix, const char *name)
+{
+   if (len < PBMC_HEADER || memcmp (data, "PBMC", 4) || get32 (data + 4) != 1)
+   {
+      warnx ("Invalid maze collection %s", name);
+      return NULL;
+   }
+   unsigned int count = get32 (data + 8);
+   if (len < PBMC_HEADER + (size_t) count * PBMC_ENTRY)
+   {
+      warnx ("Invalid maze collection %s", name);
+      return NULL;
+   }
+   const unsigned char *index = data + PBMC_HEADER,
+      *best = NULL;
+   if (n)
+   {
+      if (n < 0 || (unsigned int) n > count)
+      {
+         warnx ("No maze %d in %s (%u mazes)", n, name, count);
+         return NULL;
+      }
+      best = index + (n - 1) * PBMC_ENTRY;
+   } else
+      for (unsigned int i = 0; i < count; i++)
+      {
+         const unsigned char *e = index + i * PBMC_ENTRY;
+         if ((W && get16 (e + 8) != W) || (H && get16 (e + 10) != H))
+            continue;
+         if (best && (gets16 (best + 12) == helix) != (gets16 (e + 12) == helix))
+         {                      // Right helix is better
+            if (gets16 (e + 12) == helix)
+               best = e;
+            continue;
+         }
+         if (!best || getf (e + 16) > getf (best + 16))
+            best = e;
+      }
+   if (!best)
+   {
+      warnx ("No %dx%d maze in %s (%u mazes)", W, H, name, count);
+      return NULL;
+   }
+   if (get32 (best) > len || get32 (best + 4) > len - get32 (best))
+   {
+      warnx ("Invalid maze collection %s", name);
+      return NULL;
+   }
+   return best;
+}
+
+/**
+ * Saves a maze to a file - binary (see pb_maze_pack) if the file name ends .pbmz, else text (see pb_maze_write).
+ *
+ * @param filename Path to output file
+ * @param m Maze
+ * @param s Score, for binary (NULL if not known)
+ * @return 0 on success, 1 on error
+ */
+int
+pb_maze_save (const char *filename, const pb_maze_t * m, const pb_score_t * s)
+{
+   FILE *f = fopen (filename, "w");
+   if (!f)
+   {
+      warn ("Cannot open maze file for writing: %s", filename);
+      return 1;
+   }
+   size_t l = strlen (filename);
+   if (l > 5 && !strcasecmp (filename + l - 5, ".pbmz"))
+   {
+      size_t len = pb_maze_pack (m, s, NULL);
+      unsigned char *buf = malloc (len);
+      if (!buf)
+      {
+         warnx ("malloc");
+         fclose (f);
+         unlink (filename);
+         return 1;
+      }
+      pb_maze_pack (m, s, buf);
+      fwrite (buf, len, 1, f);
+      free (buf);
+   } else
+      pb_maze_write (m, file_sink, f);
+   if (fclose (f))
+   {
+      warn ("Cannot write maze file: %s", filename);
+      return 1;
+   }
+   return 0;
+}
+
+/**
+ * Decompresses a file with gzip or zstd, which are run as they are.
+ *
+ * @param f Open file, read from the start
+ * @param prog gzip or zstd
+ * @param data Set to the data, malloc'd
+ * @param len Set to the length
+ * @return 0 on success
+ */
+static int
+pb_decompress (FILE * f, const char *prog, unsigned char **data, size_t *len)
+{
+   *data = NULL;
+   *len = 0;
+   int p[2];
+   if (pipe (p))
+      return -1;
+   pid_t pid = fork ();
+   if (pid < 0)
+   {
+      close (p[0]);
+      close (p[1]);
+      return -1;
+   }
+   if (!pid)
+   {                            // Child
+      if (lseek (fileno (f), 0, SEEK_SET) || dup2 (fileno (f), STDIN_FILENO) < 0 || dup2 (p[1], STDOUT_FILENO) < 0)
+         _exit (1);
+      close (p[0]);
+      close (p[1]);
+      execlp (prog, prog, "-dcq", NULL);
+      _exit (1);
+   }
+   close (p[1]);
+   FILE *o = open_memstream ((char **) data, len);
+   if (!o)
+   {
+      close (p[0]);
+      waitpid (pid, NULL, 0);
+      return -1;
+   }
+   char buf[65536];
+   ssize_t l;
+   while ((l = read (p[0], buf, sizeof (buf))) > 0)
+      fwrite (buf, 1, l, o);
+   close (p[0]);
+   fclose (o);
+   int status = 0;
+   if (l < 0 || waitpid (pid, &status, 0) < 0 || !WIFEXITED (status) || WEXITSTATUS (status))
+   {
+      free (*data);
+      *data = NULL;
+      return -1;
+   }
+   return 0;
+}
+
+/**
+ * Loads a maze from a file - text (see pb_maze_write), binary (see pb_maze_pack), or a collection, any of them
+ * compressed with gzip or zstd.
+ * A collection gives the best scoring maze of the expected size and helix, or filename#N for maze N (from 1).
+ *
+ * @param filename Path to input file, with #N for a collection
+ * @param m Maze to load, m->maze is used if set (expected_W*expected_H cells), else allocated - m->helix is
+ *          used to pick from a collection
+ * @param expected_W Expected width (0 to accept any width)
+ * @param expected_H Expected height (0 to accept any height)
+ * @return 0 on success, 1 on error
+ */
+int
+pb_maze_load (const char *filename, pb_maze_t * m, int expected_W, int expected_H)
+{
+   char *name = strdup (filename);
+   if (!name)
+   {
+      warnx ("malloc");
+      return 1;
+   }
+   int n = 0;
+   char *hash = strrchr (name, '#');
+   if (hash && hash[1] && strspn (hash + 1, "0123456789") == strlen (hash + 1) && access (name, F_OK))
+   {                            // Maze number in collection
+      *hash = 0;
+      n = atoi (hash + 1);
+   }
+   FILE *f = fopen (name, "r");
+   if (!f)
+   {
+      warn ("Cannot open maze file for reading: %s", name);
+      free (name);
+      return 1;
+   }
+   char magic[4] = { 0 };
+   int got = fread (magic, 1, 4, f);
+   unsigned char *unz = NULL;   // Decompressed
+   size_t unzlen = 0;
+   if ((got >= 2 && !memcmp (magic, "\x1F\x8B", 2)) || (got == 4 && !memcmp (magic, "\x28\xB5\x2F\xFD", 4)))
+   {
+      if (pb_decompress (f, *magic == 0x1F ? "gzip" : "zstd", &unz, &unzlen))
+      {
+         warnx ("Cannot decompress maze file: %s", name);
+         fclose (f);
+         free (name);
+         return 1;
+      }
+      fclose (f);
+      memset (magic, 0, 4);
+      memcpy (magic, unz, unzlen < 4 ? unzlen : 4);
+      got = (unzlen < 4 ? unzlen : 4);
+      f = NULL;
+   }
+   if (got != 4 || (memcmp (magic, "PBMZ", 4) && memcmp (magic, "PBMC", 4)))
+   {                            // Text
+      free (name);
+      if (n)
+      {
+         if (f)
+            fclose (f);
+         free (unz);
+         warnx ("Not a maze collection: %s", filename);
+         return 1;
+      }
+      if (f)
+      {
+         rewind (f);
+         return pb_maze_load_text (filename, f, m, expected_W, expected_H);
+      }
+      if (!unzlen || !(f = fmemopen (unz, unzlen, "r")))
+      {
+         free (unz);
+         warnx ("Empty maze file: %s", filename);
+         return 1;
+      }
+      int e = pb_maze_load_text (filename, f, m, expected_W, expected_H);
+      free (unz);
+      return e;
+   }
+   // Binary, mapped, or decompressed
+   struct stat st;
+   void *map = MAP_FAILED;
+   if (f && (fstat (fileno (f), &st) || !st.st_size
+             || (map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno (f), 0)) == MAP_FAILED))
+   {
+      warn ("Cannot read maze file: %s", name);
+      fclose (f);
+      free (name);
+      return 1;
+   }
+   if (f)
+      fclose (f);
+   const unsigned char *data = (unz ? unz : map);
+   size_t len = (unz ? unzlen : (size_t) st.st_size);
+   int e = 1;
+   if (!memcmp (magic, "PBMC", 4))
+   {
+      const unsigned char *entry = pb_collection_pick (data, len, n, expected_W, expected_H, m->helix, name);
+      if (entry)
+         e = pb_maze_unpack (data + get32 (entry), get32 (entry + 4), m, NULL, expected_W, expected_H, filename);
+   } else if (n)
+      warnx ("Not a maze collection: %s", filename);
+   else
+      e = pb_maze_unpack (data, len, m, NULL, expected_W, expected_H, filename);
+   if (unz)
+      free (unz);
+   else
+      munmap (map, len);
+   free (name);
+   return e;
+}
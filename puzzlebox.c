@@ -17,39 +17,1928 @@
 #include <sys/file.h>
 #include <stdlib.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <fcntl.h>
 #include <time.h>
+#include <dirent.h>
+#include <errno.h>
+#include <libgen.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#endif
 #include "apple-strdupa.h"
+#include "puzzlebox.h"
 
-// Flags for maze array
-#define	FLAGL 0x01              // Left
-#define FLAGR 0x02              // Right
-#define FLAGU 0x04              // Up
-#define FLAGD 0x08              // Down
-#define	FLAGA 0x0F              // All directions
-#define	FLAGI 0x80              // Invalid
-
-#define	BIASL	2               // Direction bias for random maze choices
-#define	BIASR	1
-#define	BIASU	1
-#define	BIASD	4
+// Static probes (make trace) for perf, bpftrace or systemtap, e.g. perf probe -x puzzlebox-trace sdt_puzzlebox:maze_start
+#ifdef PUZZLEBOX_TRACE
+#include <sys/sdt.h>
+#define	TRACE1(n,a)	DTRACE_PROBE1(puzzlebox,n,a)
+#define	TRACE2(n,a,b)	DTRACE_PROBE2(puzzlebox,n,a,b)
+#else
+#define	TRACE1(n,a)
+#define	TRACE2(n,a,b)
+#endif
 
 #define	SCALE 1000LL            // Scales used for some aspects of output
 #define	SCALEI "0.001"
 #define	scaled(x)	((long long)round((x)*SCALE))
+#define	OUTBUF	(1 << 20)       // Output buffer, the polyhedra are most of the output
+#define	TEXTSTEPS	4       // Steps for the sloped sides of text-slow
+
+// Polyhedron points and faces are written with these rather than fprintf, as formatting them was most of the time
+/**
+ * Writes an integer, as %lld.
+ *
+ * @param o Output
+ * @param v Value
+ */
+static inline void
+out_ll (FILE * o, long long v)
+{
+   char buf[24],
+    *p = buf + sizeof (buf);
+   unsigned long long u = (v < 0 ? -(unsigned long long) v : (unsigned long long) v);
+   do
+      *--p = '0' + u % 10;
+   while (u /= 10);
+   if (v < 0)
+      *--p = '-';
+   while (p < buf + sizeof (buf))
+      putc_unlocked (*p++, o);
+}
+
+/**
+ * Writes a point or triangle as [a,b,c], in a list.
+ *
+ * @param o Output
+ * @param v Values
+ */
+static inline void
+out_3 (FILE * o, const long long *v)
+{
+   putc_unlocked ('[', o);
+   out_ll (o, v[0]);
+   putc_unlocked (',', o);
+   out_ll (o, v[1]);
+   putc_unlocked (',', o);
+   out_ll (o, v[2]);
+   putc_unlocked (']', o);
+   putc_unlocked (',', o);
+}
+
+// Output that counts what is written, as the SCAD may go to a pipe where ftell() does not work
+typedef struct
+{
+   FILE *f;                     // Where it goes
+   long n;                      // Bytes written
+} counted_t;
+
+static ssize_t
+counted_write (void *c, const char *buf, size_t len)
+{
+   counted_t *o = c;
+   if (fwrite (buf, 1, len, o->f) != len)
+      return -1;
+   o->n += len;
+   return len;
+}
+
+// Time in each stage (--timings) - each call to stage() ends the stage before, so stages cannot overlap
+enum
+{
+   STAGE_OTHER,
+   STAGE_PARSE,
+   STAGE_MAZE,
+   STAGE_SOLVE,
+   STAGE_VIZ,
+   STAGE_POINTS,
+   STAGE_FACES,
+   STAGE_NUBS,
+   STAGE_RENDER,
+   STAGE_OUTPUT,
+   STAGE_META,
+   STAGES
+};
+static const char *const stage_name[STAGES] =
+   { "other", "parse", "maze", "solve", "visualise", "points", "faces", "nubs", "render", "output", "meta" };
+static double stage_wall[STAGES],
+  stage_cpu[STAGES];            // Including child processes (openscad)
+
+/**
+ * Starts a stage, adding the time since the last call to that stage.
+ *
+ * @param s Stage
+ */
+static void
+stage (int s)
+{
+   static int now = -1;
+   static double wall,
+     cpu;
+   struct timespec t;
+   clock_gettime (CLOCK_MONOTONIC, &t);
+   struct rusage us,
+     them;
+   getrusage (RUSAGE_SELF, &us);
+   getrusage (RUSAGE_CHILDREN, &them);
+   double w = t.tv_sec + t.tv_nsec / 1e9,
+      c = us.ru_utime.tv_sec + us.ru_stime.tv_sec + them.ru_utime.tv_sec + them.ru_stime.tv_sec
+      + (us.ru_utime.tv_usec + us.ru_stime.tv_usec + them.ru_utime.tv_usec + them.ru_stime.tv_usec) / 1e6;
+   if (now >= 0)
+   {
+      stage_wall[now] += w - wall;
+      stage_cpu[now] += c - cpu;
+   }
+   now = s;
+   wall = w;
+   cpu = c;
+}
+
+// Working memory for making each maze - one block, kept for the next maze, that grows to fit
+typedef struct arena_s arena_t;
+struct arena_s
+{
+   char *base;
+   size_t size,                 // Size of base
+     used,                      // Used of base
+     taken;                     // Total taken since reset, including extra
+   void **extra;                // Blocks taken when base was full
+   int nextra;
+};
+
+/**
+ * Takes zeroed memory from the arena, which stays valid until the next arena_reset.
+ *
+ * @param a Arena
+ * @param n Bytes
+ * @return Memory
+ */
+static void *
+arena_take (arena_t * a, size_t n)
+{
+   n = (n + 15) & ~(size_t) 15; // Keep alignment
+   a->taken += n;
+   void *m;
+   if (a->used + n <= a->size)
+   {
+      m = a->base + a->used;
+      a->used += n;
+   } else
+   {                            // Full, extra block until the next reset
+      a->extra = realloc (a->extra, sizeof (*a->extra) * (a->nextra + 1));
+      if (!a->extra || !(m = malloc (n)))
+         errx (1, "malloc");
+      a->extra[a->nextra++] = m;
+   }
+   memset (m, 0, n);
+   return m;
+}
+
+/**
+ * Frees everything taken from the arena, making base big enough for all that was taken last time.
+ *
+ * @param a Arena
+ */
+static void
+arena_reset (arena_t * a)
+{
+   while (a->nextra)
+      free (a->extra[--a->nextra]);
+   if (a->taken > a->size)
+   {
+      free (a->base);
+      if (!(a->base = malloc (a->taken)))
+         errx (1, "malloc");
+      a->size = a->taken;
+   }
+   a->used = a->taken = 0;
+}
+
+static void
+arena_free (arena_t * a)
+{
+   arena_reset (a);
+   free (a->extra);
+   free (a->base);
+   memset (a, 0, sizeof (*a));
+}
+
+// Slice angles around a maze, kept for each number of slices, as mazes on parts are often the same size
+typedef struct angles_s angles_t;
+struct angles_s
+{
+   angles_t *next;
+   int n,                       // Slices
+     mirror;                    // Angles are 2 * pi - a
+   double *sin,
+    *cos;
+};
+static angles_t *angle_tables = NULL;
+
+/**
+ * Gets sin and cos for each slice S of n around, a = 2 * pi * (S - 1.5) / n, made the first time.
+ *
+ * @param n Slices
+ * @param mirror Angles are 2 * pi - a (maze on the outside)
+ * @return Table
+ */
+static const angles_t *
+slice_angles (int n, int mirror)
+{
+   angles_t *t;
+   for (t = angle_tables; t && (t->n != n || t->mirror != mirror); t = t->next);
+   if (t)
+      return t;
+   if (!(t = malloc (sizeof (*t))) || !(t->sin = malloc (sizeof (double) * n)) || !(t->cos = malloc (sizeof (double) * n)))
+      errx (1, "malloc");
+   for (int S = 0; S < n; S++)
+   {
+      double a = M_PI * 2 * (S - 1.5) / n;
+      if (mirror)
+         a = M_PI * 2 - a;
+      t->sin[S] = sin (a);
+      t->cos[S] = cos (a);
+   }
+   t->n = n;
+   t->mirror = mirror;
+   t->next = angle_tables;
+   angle_tables = t;
+   return t;
+}
+
+/**
+ * FNV-1a hash.
+ *
+ * @param h Hash so far (start with 14695981039346656037)
+ * @param p Data
+ * @param n Bytes
+ * @return Hash
+ */
+static unsigned long long
+fnv64 (unsigned long long h, const void *p, size_t n)
+{
+   for (const unsigned char *c = p; n--; c++)
+      h = (h ^ *c) * 1099511628211ULL;
+   return h;
+}
+
+// Transforms about the Z axis (all that is needed for placing parts) as 2x3 matrix for X/Y
+static void
+xf_apply (const double *xf, double *x, double *y)
+{
+   double X = *x,
+      Y = *y;
+   *x = xf[0] * X + xf[1] * Y + xf[2];
+   *y = xf[3] * X + xf[4] * Y + xf[5];
+}
+
+static void
+xf_mul (double *xf, double a, double b, double c, double d, double e, double f)
+{                               // xf = xf * [a b c / d e f]
+   double r[6] = {
+      xf[0] * a + xf[1] * d, xf[0] * b + xf[1] * e, xf[0] * c + xf[1] * f + xf[2],
+      xf[3] * a + xf[4] * d, xf[3] * b + xf[4] * e, xf[3] * c + xf[4] * f + xf[5]
+   };
+   memcpy (xf, r, sizeof (r));
+}
+
+static void
+xf_translate (double *xf, double x, double y)
+{
+   xf_mul (xf, 1, 0, x, 0, 1, y);
+}
+
+static void
+xf_rotate (double *xf, double degrees)
+{                               // As openscad rotate([0,0,degrees])
+   double a = degrees * M_PI / 180,
+      s = sin (a),
+      c = cos (a);
+   xf_mul (xf, c, -s, 0, s, c, 0);
+}
+
+static void
+xf_mirrorx (double *xf)
+{                               // As openscad mirror([1,0,0])
+   xf_mul (xf, -1, 0, 0, 0, 1, 0);
+}
+
+static int
+xf_flipped (const double *xf)
+{                               // Transform is a reflection so faces need reversing
+   return xf[0] * xf[4] - xf[1] * xf[3] < 0;
+}
+
+static void
+xf_invert (double *xf)
+{                               // xf = xf^-1
+   double d = xf[0] * xf[4] - xf[1] * xf[3],
+      a = xf[4] / d,
+      b = -xf[1] / d,
+      c = -xf[3] / d,
+      e = xf[0] / d;
+   double r[6] = { a, b, -a * xf[2] - b * xf[5], c, e, -c * xf[2] - e * xf[5] };
+   memcpy (xf, r, sizeof (r));
+}
+
+// Native mesh output (--native) - the explicit polyhedra and solids of revolution are also collected as meshes
+// so that STL/3MF can be written directly without running openscad
+typedef struct mesh_s mesh_t;
+struct mesh_s
+{
+   mesh_t *next;
+   int part;                    // Part this mesh belongs to
+   int np,                      // Points (mm, x/y/z)
+     maxp;
+   double *p;
+   int nt,                      // Triangles (counter-clockwise viewed from outside)
+     maxt;
+   int *t;
+   const mesh_t *of;            // If set this is a copy of that mesh placed with xf, and has no points or triangles of its own
+   double xf[6];
+};
+
+/**
+ * Adds a new empty mesh to the end of a list of meshes.
+ *
+ * @param list Pointer to head of the list
+ * @param part Part number the mesh belongs to
+ * @return The new mesh
+ */
+static mesh_t *
+mesh_new (mesh_t ** list, int part)
+{
+   mesh_t *m = calloc (1, sizeof (*m));
+   if (!m)
+      errx (1, "malloc");
+   m->part = part;
+   while (*list)
+      list = &(*list)->next;
+   *list = m;
+   return m;
+}
+
+/**
+ * Adds a copy of a mesh, placed with a transform about the Z axis, as the same nub or park ridge repeated round a part.
+ * The copy shares the mesh's points and triangles, so a 3MF has the mesh once with a component for each copy.
+ *
+ * @param list Pointer to head of the list
+ * @param part Part number the copy belongs to
+ * @param of Mesh to copy, which is not itself a copy
+ * @param xf Transform from the mesh to the copy (see xf_apply)
+ * @return The new mesh
+ */
+static mesh_t *
+mesh_instance (mesh_t ** list, int part, const mesh_t * of, const double *xf)
+{
+   mesh_t *m = mesh_new (list, part);
+   m->of = of;
+   memcpy (m->xf, xf, sizeof (m->xf));
+   return m;
+}
+
+/**
+ * Adds a point to a mesh.
+ *
+ * @return Index of the point within the mesh
+ */
+static int
+mesh_point (mesh_t * m, double x, double y, double z)
+{
+   if (m->np >= m->maxp)
+   {
+      m->maxp = m->maxp * 2 + 1024;
+      m->p = realloc (m->p, sizeof (*m->p) * 3 * m->maxp);
+      if (!m->p)
+         errx (1, "malloc");
+   }
+   m->p[m->np * 3 + 0] = x;
+   m->p[m->np * 3 + 1] = y;
+   m->p[m->np * 3 + 2] = z;
+   return m->np++;
+}
+
+/**
+ * Adds a triangle to a mesh, points in counter-clockwise order viewed from outside.
+ */
+static void
+mesh_tri (mesh_t * m, int a, int b, int c)
+{
+   if (a == b || b == c || c == a)
+      return;                   // Degenerate
+   if (m->nt >= m->maxt)
+   {
+      m->maxt = m->maxt * 2 + 1024;
+      m->t = realloc (m->t, sizeof (*m->t) * 3 * m->maxt);
+      if (!m->t)
+         errx (1, "malloc");
+   }
+   m->t[m->nt * 3 + 0] = a;
+   m->t[m->nt * 3 + 1] = b;
+   m->t[m->nt * 3 + 2] = c;
+   m->nt++;
+}
+
+/**
+ * Adds a polygon face to a mesh as a triangle fan.
+ *
+ * @param n Number of points in face
+ * @param v Point indices
+ * @param cw If set the points are clockwise viewed from outside (as for openscad polyhedron faces)
+ */
+static void
+mesh_face (mesh_t * m, int n, const int *v, int cw)
+{
+   for (int i = 1; i + 1 < n; i++)
+      if (cw)
+         mesh_tri (m, v[0], v[i + 1], v[i]);
+      else
+         mesh_tri (m, v[0], v[i], v[i + 1]);
+}
+
+/**
+ * Makes a closed mesh face outwards, reversing all triangles if its signed volume is negative.
+ * Openscad does not care about polyhedron face order, but STL/3MF should have faces outwards.
+ */
+static void
+mesh_orient (mesh_t * m)
+{
+   double v = 0;
+   for (int t = 0; t < m->nt; t++)
+   {
+      const double *a = m->p + m->t[t * 3] * 3,
+         *b = m->p + m->t[t * 3 + 1] * 3,
+         *c = m->p + m->t[t * 3 + 2] * 3;
+      v += a[0] * (b[1] * c[2] - b[2] * c[1]) - a[1] * (b[0] * c[2] - b[2] * c[0]) + a[2] * (b[0] * c[1] - b[1] * c[0]);
+   }
+   if (v < 0)
+      for (int t = 0; t < m->nt; t++)
+      {
+         int x = m->t[t * 3 + 1];
+         m->t[t * 3 + 1] = m->t[t * 3 + 2];
+         m->t[t * 3 + 2] = x;
+      }
+}
+
+/**
+ * Writes a mesh, to be read back by mesh_read (same host, for the part cache).
+ */
+static void
+mesh_write (FILE * f, const mesh_t * m)
+{
+   fwrite (&m->part, sizeof (m->part), 1, f);
+   if (m->of)
+   {                            // A copy is written out in full
+      const mesh_t *o = m->of;
+      fwrite (&o->np, sizeof (o->np), 1, f);
+      fwrite (&o->nt, sizeof (o->nt), 1, f);
+      for (int i = 0; i < o->np; i++)
+      {
+         double v[3] = { o->p[i * 3], o->p[i * 3 + 1], o->p[i * 3 + 2] };
+         xf_apply (m->xf, &v[0], &v[1]);
+         fwrite (v, sizeof (v), 1, f);
+      }
+      for (int t = 0; t < o->nt; t++)
+         fwrite ((int[3]) { o->t[t * 3], o->t[t * 3 + (xf_flipped (m->xf) ? 2 : 1)], o->t[t * 3 + (xf_flipped (m->xf) ? 1 : 2)] },
+                 sizeof (int) * 3, 1, f);
+      return;
+   }
+   fwrite (&m->np, sizeof (m->np), 1, f);
+   fwrite (&m->nt, sizeof (m->nt), 1, f);
+   fwrite (m->p, sizeof (*m->p) * 3, m->np, f);
+   fwrite (m->t, sizeof (*m->t) * 3, m->nt, f);
+}
+
+/**
+ * Reads a mesh written by mesh_write on to the end of a list of meshes.
+ *
+ * @return 0 on success
+ */
+static int
+mesh_read (FILE * f, mesh_t ** list)
+{
+   int part,
+     np,
+     nt;
+   if (fread (&part, sizeof (part), 1, f) != 1 || fread (&np, sizeof (np), 1, f) != 1 || fread (&nt, sizeof (nt), 1, f) != 1
+       || np < 0 || nt < 0)
+      return -1;
+   mesh_t *m = mesh_new (list, part);
+   m->maxp = m->np = np;
+   m->maxt = m->nt = nt;
+   if (!(m->p = malloc (sizeof (*m->p) * 3 * np + 1)) || !(m->t = malloc (sizeof (*m->t) * 3 * nt + 1)))
+      errx (1, "malloc");
+   if (fread (m->p, sizeof (*m->p) * 3, np, f) != (size_t) np || fread (m->t, sizeof (*m->t) * 3, nt, f) != (size_t) nt)
+      return -1;
+   return 0;
+}
+
+/**
+ * Frees a list of meshes.
+ */
+static void
+mesh_free (mesh_t * m)
+{
+   while (m)
+   {
+      mesh_t *next = m->next;
+      free (m->p);
+      free (m->t);
+      free (m);
+      m = next;
+   }
+}
+
+/**
+ * Distance from the centre to the edge of a regular polygon, rounded as minkowski() with a circle.
+ *
+ * @param sides Number of sides, with a corner at angle 0
+ * @param r Radius of the corners before rounding
+ * @param round Radius of the rounding circle (0 for none)
+ * @param a Angle (radians)
+ * @return Distance along angle a
+ */
+static double
+poly_radius (int sides, double r, double round, double a)
+{
+   double s = 2 * M_PI / sides,
+      d = a - floor (a / s) * s - s / 2,        // Angle from middle of side
+      t = (r * cos (s / 2) + round) / cos (d);
+   if (fabs (t * sin (d)) <= r * sin (s / 2))
+      return t;                 // On the flat of the side
+   double c = r * cos (s / 2 - fabs (d));       // On the corner's circle
+   return c + sqrt (c * c - r * r + round * round);
+}
+
+/**
+ * Adds a solid of revolution around the Z axis, as openscad rotate_extrude() of a polygon.
+ * Profile points on the axis (r=0) become a single point.
+ * If sides is set then profile points outside hole are on a polygon of that many sides instead of a circle, with r as
+ * the radius of its corners, as a prism with a rotate_extrude() of the same $fn cut from it, and those at the furthest
+ * r are on that polygon less round, rounded by round, as the chamfered outer() base.
+ *
+ * @param n Number of profile points
+ * @param rz Profile as r/z pairs, counter-clockwise (r to the right, z up)
+ * @param segs Number of segments around (as $fn, a multiple of sides if set)
+ * @param xf Transform to world X/Y (see xf_apply)
+ * @param sides Sides of polygon, or 0
+ * @param hole Radius within which the profile is round
+ * @param round Rounding of furthest points
+ */
+static void
+mesh_revolve (mesh_t * m, int n, const double *rz, int segs, const double *xf, int sides, double hole, double round)
+{
+   int base[n];
+   double far = 0;
+   for (int i = 0; i < n; i++)
+      if (rz[i * 2] > far)
+         far = rz[i * 2];
+   for (int i = 0; i < n; i++)
+   {
+      base[i] = m->np;
+      for (int j = 0; j < (rz[i * 2] > 0 ? segs : 1); j++)
+      {
+         double a = 2 * M_PI * j / segs,
+            r = rz[i * 2];
+         if (sides && r > hole)
+            r = (r >= far ? poly_radius (sides, r - round, round, a) : poly_radius (sides, r, 0, a));
+         double x = r * cos (a),
+            y = r * sin (a);
+         xf_apply (xf, &x, &y);
+         mesh_point (m, x, y, rz[i * 2 + 1]);
+      }
+   }
+   int flip = xf_flipped (xf);
+   for (int i = 0; i < n; i++)
+   {
+      int i2 = (i + 1) % n;
+      int a0 = rz[i * 2] > 0,
+         b0 = rz[i2 * 2] > 0;
+      for (int j = 0; j < segs; j++)
+      {
+         int j2 = (j + 1) % segs;
+         int a = base[i] + (a0 ? j : 0),
+            a2 = base[i] + (a0 ? j2 : 0),
+            b = base[i2] + (b0 ? j : 0),
+            b2 = base[i2] + (b0 ? j2 : 0);
+         if (flip)
+         {
+            mesh_tri (m, a, b, b2);
+            mesh_tri (m, a, b2, a2);
+         } else
+         {
+            mesh_tri (m, a, a2, b2);
+            mesh_tri (m, a, b2, b);
+         }
+      }
+   }
+}
+
+/**
+ * Cuts a pocket into a flat top quad of a mesh, inset a quarter from each edge, as the position 0 mark.
+ *
+ * @param q Points of the quad, in order round it, as made by two triangles of the mesh
+ * @param depth Depth of pocket
+ * @return 0 if done, -1 if the quad is not in the mesh
+ */
+static int
+mesh_pocket (mesh_t * m, const int *q, double depth)
+{
+   int t0 = -1,
+      t1 = -1,
+      rev = 0;
+   for (int t = 0; t < m->nt; t++)
+   {
+      int in = 0;
+      for (int k = 0; k < 3; k++)
+         for (int i = 0; i < 4; i++)
+            if (m->t[t * 3 + k] == q[i])
+               in++;
+      if (in < 3)
+         continue;
+      for (int k = 0; k < 3; k++)
+         if (m->t[t * 3 + k] == q[1] && m->t[t * 3 + (k + 1) % 3] == q[0])
+            rev = 1;
+      if (t0 < 0)
+         t0 = t;
+      else
+         t1 = t;
+   }
+   if (t1 < 0)
+      return -1;
+   int Q[4],
+     p[4],
+     f[4];
+   for (int i = 0; i < 4; i++)
+      Q[i] = q[rev ? 3 - i : i];
+   for (int i = 0; i < 4; i++)
+   {                            // Inset points, on the bilinear quarters
+      const double *a = m->p + Q[i] * 3,
+         *b = m->p + Q[(i + 1) % 4] * 3,
+         *c = m->p + Q[(i + 2) % 4] * 3,
+         *d = m->p + Q[(i + 3) % 4] * 3;
+      double x = (a[0] * 9 + b[0] * 3 + c[0] + d[0] * 3) / 16,
+         y = (a[1] * 9 + b[1] * 3 + c[1] + d[1] * 3) / 16,
+         z = (a[2] * 9 + b[2] * 3 + c[2] + d[2] * 3) / 16;
+      p[i] = mesh_point (m, x, y, z);
+      f[i] = mesh_point (m, x, y, z - depth);
+   }
+   m->nt--;                     // Remove the quad's triangles, the later first
+   memmove (m->t + t1 * 3, m->t + t1 * 3 + 3, sizeof (*m->t) * 3 * (m->nt - t1));
+   m->nt--;
+   memmove (m->t + t0 * 3, m->t + t0 * 3 + 3, sizeof (*m->t) * 3 * (m->nt - t0));
+   for (int i = 0; i < 4; i++)
+   {
+      int i2 = (i + 1) % 4;
+      mesh_tri (m, Q[i], Q[i2], p[i2]); // Round the top
+      mesh_tri (m, Q[i], p[i2], p[i]);
+      mesh_tri (m, p[i], p[i2], f[i2]); // Sides
+      mesh_tri (m, p[i], f[i2], f[i]);
+   }
+   mesh_tri (m, f[0], f[1], f[2]);      // Bottom
+   mesh_tri (m, f[0], f[2], f[3]);
+   return 0;
+}
+
+/**
+ * Cuts a convex polygon out of a revolve profile, as openscad difference() of a rotate_extrude() cut out,
+ * for the simple case where the cut takes a bite out of a single edge of the profile.
+ *
+ * @param rz Profile as r/z pairs, counter-clockwise, updated in place
+ * @param n Pointer to number of profile points, updated
+ * @param max Space in rz for points
+ * @param g Convex polygon to remove, counter-clockwise, r/z pairs
+ * @param gn Number of points in g
+ * @return 0 if done, -1 if cut is not a simple bite from one edge
+ */
+static int
+profile_cut (double *rz, int *n, int max, const double *g, int gn)
+{
+   int cut = -1,
+      cutin = 0,
+      cutout = 0;
+   double cutt0 = 0,
+      cutt1 = 0;
+   for (int k = 0; k < *n; k++)
+   {                            // Clip each edge against g (Cyrus-Beck)
+      const double *a = rz + k * 2,
+         *b = rz + ((k + 1) % *n) * 2;
+      double t0 = 0,
+         t1 = 1;
+      int in = -1,
+         out = -1,
+         miss = 0;
+      for (int j = 0; j < gn && !miss; j++)
+      {
+         const double *v = g + j * 2,
+            *v2 = g + ((j + 1) % gn) * 2;
+         double nr = v2[1] - v[1],
+            nz = v[0] - v2[0];  // Outward normal
+         double num = nr * (a[0] - v[0]) + nz * (a[1] - v[1]),
+            den = nr * (b[0] - a[0]) + nz * (b[1] - a[1]);
+         if (den == 0)
+         {
+            if (num > 0)
+               miss = 1;
+            continue;
+         }
+         double t = -num / den;
+         if (den < 0 && t > t0)
+         {
+            t0 = t;
+            in = j;
+         } else if (den > 0 && t < t1)
+         {
+            t1 = t;
+            out = j;
+         }
+      }
+      if (miss || t0 >= t1)
+         continue;
+      if (cut >= 0 || in < 0 || out < 0)
+         return -1;             // More than one edge, or not a bite out of the middle of the edge
+      cut = k;
+      cutin = in;
+      cutout = out;
+      cutt0 = t0;
+      cutt1 = t1;
+   }
+   if (cut < 0)
+      return 0;                 // Nothing to cut
+   int chain = (cutin - cutout + gn) % gn;
+   if (*n + 2 + chain > max)
+      return -1;
+   const double *a = rz + cut * 2,
+      *b = rz + ((cut + 1) % *n) * 2;
+   double new[(2 + chain) * 2];
+   new[0] = a[0] + (b[0] - a[0]) * cutt0;
+   new[1] = a[1] + (b[1] - a[1]) * cutt0;
+   for (int i = 0; i < chain; i++)
+   {                            // Clockwise round g from entry to exit
+      int j = (cutin - i + gn) % gn;
+      new[2 + i * 2] = g[j * 2];
+      new[3 + i * 2] = g[j * 2 + 1];
+   }
+   new[2 + chain * 2] = a[0] + (b[0] - a[0]) * cutt1;
+   new[3 + chain * 2] = a[1] + (b[1] - a[1]) * cutt1;
+   memmove (rz + (cut + 3 + chain) * 2, rz + (cut + 1) * 2, sizeof (*rz) * 2 * (*n - cut - 1));
+   memcpy (rz + (cut + 1) * 2, new, sizeof (new));
+   *n += 2 + chain;
+   return 0;
+}
+
+static void
+put_le (FILE * o, unsigned long v, int n)
+{                               // Little endian binary
+   while (n--)
+   {
+      fputc (v & 0xFF, o);
+      v >>= 8;
+   }
+}
+
+static void
+put_float (FILE * o, float f)
+{
+   unsigned int v;
+   memcpy (&v, &f, sizeof (v));
+   put_le (o, v, 4);
+}
+
+/**
+ * Writes meshes as one binary STL.
+ *
+ * @param o Output
+ * @param list Meshes
+ * @param part Only the meshes for this part, 0 for all
+ */
+static void
+mesh_write_stl (FILE * o, mesh_t * list, int part)
+{
+   char header[80] = "Puzzlebox by RevK, @TheRealRevK www.me.uk";
+   fwrite (header, sizeof (header), 1, o);
+   unsigned long count = 0;
+   for (mesh_t * m = list; m; m = m->next)
+      if (!part || m->part == part)
+         count += (m->of ? : m)->nt;
+   put_le (o, count, 4);
+   for (mesh_t * m = list; m; m = m->next)
+      for (int t = 0; t < (m->of ? : m)->nt && (!part || m->part == part); t++)
+      {
+         double v[3][3];
+         for (int i = 0; i < 3; i++)
+         {
+            const mesh_t *s = (m->of ? : m);
+            const double *p = s->p + s->t[t * 3 + (m->of && xf_flipped (m->xf) && i ? 3 - i : i)] * 3;
+            memcpy (v[i], p, sizeof (v[i]));
+            if (m->of)
+               xf_apply (m->xf, &v[i][0], &v[i][1]);
+         }
+         const double *a = v[0],
+            *b = v[1],
+            *c = v[2];
+         double ux = b[0] - a[0],
+            uy = b[1] - a[1],
+            uz = b[2] - a[2],
+            vx = c[0] - a[0],
+            vy = c[1] - a[1],
+            vz = c[2] - a[2];
+         double nx = uy * vz - uz * vy,
+            ny = uz * vx - ux * vz,
+            nz = ux * vy - uy * vx,
+            l = sqrt (nx * nx + ny * ny + nz * nz);
+         if (l > 0)
+         {
+            nx /= l;
+            ny /= l;
+            nz /= l;
+         }
+         put_float (o, nx);
+         put_float (o, ny);
+         put_float (o, nz);
+         for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+               put_float (o, v[i][j]);
+         put_le (o, 0, 2);
+      }
+}
+
+static unsigned long
+crc32 (const unsigned char *p, size_t len)
+{                               // As used by zip
+   static unsigned long table[256];
+   if (!table[1])
+      for (int i = 0; i < 256; i++)
+      {
+         unsigned long c = i;
+         for (int k = 0; k < 8; k++)
+            c = (c & 1) ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+         table[i] = c;
+      }
+   unsigned long c = 0xFFFFFFFFUL;
+   while (len--)
+      c = table[(c ^ *p++) & 0xFF] ^ (c >> 8);
+   return c ^ 0xFFFFFFFFUL;
+}
+
+// A file in a zip
+typedef struct zip_file_s zip_file_t;
+struct zip_file_s
+{
+   const char *name;
+   char *data;                  // Malloc'd, freed by zip_write
+   size_t len;
+   unsigned long crc,
+     offset;
+};
+
+/**
+ * Writes files as a zip (stored, not compressed), and frees their data.
+ *
+ * @param o Output
+ * @param file Files
+ * @param n Number of files
+ */
+static void
+zip_write (FILE * o, zip_file_t * file, int n)
+{
+   unsigned long offset = 0;
+   for (int i = 0; i < n; i++)
+   {                            // Local headers and data
+      size_t namelen = strlen (file[i].name);
+      file[i].crc = crc32 ((unsigned char *) file[i].data, file[i].len);
+      file[i].offset = offset;
+      put_le (o, 0x04034b50, 4);
+      put_le (o, 20, 2);        // Version
+      put_le (o, 0, 2);         // Flags
+      put_le (o, 0, 2);         // Stored
+      put_le (o, 0, 4);         // Time/date
+      put_le (o, file[i].crc, 4);
+      put_le (o, file[i].len, 4);
+      put_le (o, file[i].len, 4);
+      put_le (o, namelen, 2);
+      put_le (o, 0, 2);
+      fwrite (file[i].name, namelen, 1, o);
+      fwrite (file[i].data, file[i].len, 1, o);
+      offset += 30 + namelen + file[i].len;
+   }
+   unsigned long dir = offset;
+   for (int i = 0; i < n; i++)
+   {                            // Central directory
+      size_t namelen = strlen (file[i].name);
+      put_le (o, 0x02014b50, 4);
+      put_le (o, 20, 2);        // Made by
+      put_le (o, 20, 2);        // Version
+      put_le (o, 0, 2);
+      put_le (o, 0, 2);
+      put_le (o, 0, 4);
+      put_le (o, file[i].crc, 4);
+      put_le (o, file[i].len, 4);
+      put_le (o, file[i].len, 4);
+      put_le (o, namelen, 2);
+      put_le (o, 0, 2);         // Extra
+      put_le (o, 0, 2);         // Comment
+      put_le (o, 0, 2);         // Disk
+      put_le (o, 0, 2);         // Internal attributes
+      put_le (o, 0, 4);         // External attributes
+      put_le (o, file[i].offset, 4);
+      fwrite (file[i].name, namelen, 1, o);
+      offset += 46 + namelen;
+   }
+   put_le (o, 0x06054b50, 4);   // End of central directory
+   put_le (o, 0, 2);
+   put_le (o, 0, 2);
+   put_le (o, n, 2);
+   put_le (o, n, 2);
+   put_le (o, offset - dir, 4);
+   put_le (o, dir, 4);
+   put_le (o, 0, 2);
+   for (int i = 0; i < n; i++)
+      free (file[i].data);
+}
+
+/**
+ * Writes all meshes as a 3MF (zip, stored), one object per part made up of one component per mesh.
+ */
+static void
+mesh_write_3mf (FILE * o, mesh_t * list)
+{
+   zip_file_t file[3] = {
+      {"[Content_Types].xml"},
+      {"_rels/.rels"},
+      {"3D/3dmodel.model"},
+   };
+   file[0].data =
+      strdup ("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+              "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">"
+              "<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>"
+              "<Default Extension=\"model\" ContentType=\"application/vnd.ms-package.3dmanufacturing-3dmodel+xml\"/>" "</Types>\n");
+   file[1].data =
+      strdup ("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+              "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">"
+              "<Relationship Target=\"/3D/3dmodel.model\" Id=\"rel0\" Type=\"http://schemas.microsoft.com/3dmanufacturing/2013/01/3dmodel\"/>"
+              "</Relationships>\n");
+   {                            // Model
+      FILE *x = open_memstream (&file[2].data, &file[2].len);
+      if (!x)
+         err (1, "open_memstream");
+      fprintf (x, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+               "<model unit=\"millimeter\" xml:lang=\"en-US\" xmlns=\"http://schemas.microsoft.com/3dmanufacturing/core/2015/02\">\n"
+               "<resources>\n");
+      int id = 0,
+         maxpart = 0;
+      int object (const mesh_t * o)
+      {                         // Object id of a mesh that is not a copy
+         int n = 0;
+         for (mesh_t * m = list; m; m = m->next)
+            if (!m->of)
+            {
+               n++;
+               if (m == o)
+                  break;
+            }
+         return n;
+      }
+      for (mesh_t * m = list; m; m = m->next)
+      {
+         if (m->part > maxpart)
+            maxpart = m->part;
+         if (m->of)
+            continue;           // Copies are components of the same object
+         fprintf (x, "<object id=\"%d\" type=\"model\"><mesh><vertices>\n", ++id);
+         for (int i = 0; i < m->np; i++)
+            fprintf (x, "<vertex x=\"%.3f\" y=\"%.3f\" z=\"%.3f\"/>\n", m->p[i * 3], m->p[i * 3 + 1], m->p[i * 3 + 2]);
+         fprintf (x, "</vertices><triangles>\n");
+         for (int i = 0; i < m->nt; i++)
+            fprintf (x, "<triangle v1=\"%d\" v2=\"%d\" v3=\"%d\"/>\n", m->t[i * 3], m->t[i * 3 + 1], m->t[i * 3 + 2]);
+         fprintf (x, "</triangles></mesh></object>\n");
+      }
+      int meshes = id;
+      for (int part = 0; part <= maxpart; part++)
+      {
+         mesh_t *m;
+         for (m = list; m && m->part != part; m = m->next);
+         if (!m)
+            continue;
+         fprintf (x, "<object id=\"%d\" type=\"model\" name=\"part%d\"><components>\n", meshes + 1 + part, part);
+         for (m = list; m; m = m->next)
+            if (m->part == part)
+            {
+               if (m->of)
+                  fprintf (x, "<component objectid=\"%d\" transform=\"%.6f %.6f 0 %.6f %.6f 0 0 0 1 %.3f %.3f 0\"/>\n",
+                           object (m->of), m->xf[0], m->xf[3], m->xf[1], m->xf[4], m->xf[2], m->xf[5]);
+               else
+                  fprintf (x, "<component objectid=\"%d\"/>\n", object (m));
+            }
+         fprintf (x, "</components></object>\n");
+      }
+      fprintf (x, "</resources>\n<build>\n");
+      for (int part = 0; part <= maxpart; part++)
+         for (mesh_t * m = list; m; m = m->next)
+            if (m->part == part)
+            {
+               fprintf (x, "<item objectid=\"%d\"/>\n", meshes + 1 + part);
+               break;
+            }
+      fprintf (x, "</build>\n</model>\n");
+      fclose (x);
+   }
+   file[0].len = strlen (file[0].data);
+   file[1].len = strlen (file[1].data);
+   zip_write (o, file, 3);
+}
 
 /**
- * Main entry point for the puzzle box generator.
+ * Writes meshes as a zip of one binary STL per part, partN.stl.
+ */
+static void
+mesh_write_zip (FILE * o, mesh_t * list)
+{
+   int maxpart = 0;
+   for (mesh_t * m = list; m; m = m->next)
+      if (m->part > maxpart)
+         maxpart = m->part;
+   zip_file_t file[maxpart + 1];
+   char names[maxpart + 1][20];
+   int n = 0;
+   for (int part = 0; part <= maxpart; part++)
+   {
+      mesh_t *m;
+      for (m = list; m && m->part != part; m = m->next);
+      if (!m)
+         continue;
+      memset (&file[n], 0, sizeof (file[n]));
+      sprintf (names[n], "part%d.stl", part);
+      file[n].name = names[n];
+      FILE *x = open_memstream (&file[n].data, &file[n].len);
+      if (!x)
+         err (1, "open_memstream");
+      mesh_write_stl (x, list, part);
+      fclose (x);
+      n++;
+   }
+   zip_write (o, file, n);
+}
+
+/**
+ * Reads an STL (binary or ASCII, as from openscad) as a new mesh, with the same points joined up.
+ *
+ * @param filename STL file
+ * @param list Meshes, added to the end
+ * @param part Part the mesh belongs to
+ * @return 0 on success
+ */
+static int
+mesh_read_stl (const char *filename, mesh_t ** list, int part)
+{
+   FILE *f = fopen (filename, "r");
+   if (!f)
+      return -1;
+   mesh_t *m = mesh_new (list, part);
+   unsigned int hashsize = 1 << 16,
+      *hash = calloc (hashsize, sizeof (*hash));        // Point index + 1, open addressing
+   if (!hash)
+      errx (1, "malloc");
+   int point (double x, double y, double z)
+   {                            // Point index, new or the same as one before
+      if (m->np * 2 >= (int) hashsize)
+      {                         // Grow
+         free (hash);
+         hashsize *= 2;
+         if (!(hash = calloc (hashsize, sizeof (*hash))))
+            errx (1, "malloc");
+         for (int i = 0; i < m->np; i++)
+         {
+            unsigned long long h = fnv64 (14695981039346656037ULL, m->p + i * 3, sizeof (*m->p) * 3);
+            while (hash[h & (hashsize - 1)])
+               h++;
+            hash[h & (hashsize - 1)] = i + 1;
+         }
+      }
+      double v[3] = { x + 0.0, y + 0.0, z + 0.0 };      // No -0
+      unsigned long long h = fnv64 (14695981039346656037ULL, v, sizeof (v));
+      for (; hash[h & (hashsize - 1)]; h++)
+         if (!memcmp (m->p + (hash[h & (hashsize - 1)] - 1) * 3, v, sizeof (v)))
+            return hash[h & (hashsize - 1)] - 1;
+      hash[h & (hashsize - 1)] = m->np + 1;
+      return mesh_point (m, v[0], v[1], v[2]);
+   }
+   unsigned char head[84];
+   struct stat st;
+   int e = 0;
+   if (fread (head, sizeof (head), 1, f) == 1 && !fstat (fileno (f), &st)
+       && st.st_size == 84 + 50 * (off_t) (head[80] | head[81] << 8 | head[82] << 16 | (unsigned long) head[83] << 24))
+   {                            // Binary
+      unsigned char t[50];
+      while (fread (t, sizeof (t), 1, f) == 1)
+      {
+         int v[3];
+         for (int i = 0; i < 3; i++)
+         {
+            float c[3];
+            memcpy (c, t + 12 + i * 12, sizeof (c));
+            v[i] = point (c[0], c[1], c[2]);
+         }
+         mesh_tri (m, v[0], v[1], v[2]);
+      }
+   } else
+   {                            // ASCII
+      rewind (f);
+      char line[256];
+      int v[3],
+        n = 0;
+      while (fgets (line, sizeof (line), f))
+      {
+         double x,
+           y,
+           z;
+         if (sscanf (line, " vertex %lf %lf %lf", &x, &y, &z) != 3)
+            continue;
+         v[n++] = point (x, y, z);
+         if (n == 3)
+         {
+            mesh_tri (m, v[0], v[1], v[2]);
+            n = 0;
+         }
+      }
+      if (!m->nt)
+         e = -1;
+   }
+   free (hash);
+   fclose (f);
+   return e;
+}
+
+/**
+ * Waits for a free openscad render slot, in order of arrival.
+ * Slots are lock files (lock, lock.1, lock.2...) held with flock until closed, so released on exit.
+ * Waiting processes leave a marker file lock.q.<time>.<pid> so the queue is first come first served,
+ * can be counted, and entries from processes that have died are ignored and removed.
+ *
+ * @param lock Lock file name for slot 0, the others have .N appended
+ * @param slots Number of slots (concurrent renders) allowed
+ * @param waited Set to seconds spent waiting
+ * @param depth Set to number waiting (including this one) when we joined the queue
+ * @return File descriptor holding the slot, close to release
+ */
+static int
+render_slot (const char *lock, int slots, double *waited, int *depth)
+{
+   if (slots < 1)
+      slots = 1;
+   int try (void)
+   {                            // Try each slot without waiting
+      for (int n = 0; n < slots; n++)
+      {
+         char *name = NULL;
+         if (n)
+         {
+            if (asprintf (&name, "%s.%d", lock, n) < 0)
+               errx (1, "malloc");
+         }
+         int fd = open (name ? : lock, O_CREAT | O_RDWR, 0666);
+         free (name);
+         if (fd < 0)
+            continue;
+         if (!flock (fd, LOCK_EX | LOCK_NB))
+            return fd;
+         close (fd);
+      }
+      return -1;
+   }
+   *waited = 0;
+   *depth = 0;
+   char *dir = strdupa (lock),
+      *base = strdupa (lock);
+   dir = dirname (dir);
+   base = basename (base);
+   char *marker = NULL;         // Our place in the queue, once we join it
+   int dfd = open (dir, O_RDONLY | O_DIRECTORY);
+   if (dfd < 0)
+      err (1, "Cannot open %s", dir);
+   int ahead (int count)
+   {                            // Number of live waiters ahead of us (or all, if count set, as before we join)
+      int n = 0;
+      size_t l = strlen (base);
+      DIR *d = fdopendir (dup (dfd));
+      if (!d)
+         return 0;
+      rewinddir (d);
+      struct dirent *e;
+      while ((e = readdir (d)))
+      {
+         if (strncmp (e->d_name, base, l) || strncmp (e->d_name + l, ".q.", 3))
+            continue;
+         if (!count && strcmp (e->d_name, marker) >= 0)
+            continue;
+         char *p = strrchr (e->d_name, '.');
+         int pid = p ? atoi (p + 1) : 0;
+         if (pid <= 0 || (kill (pid, 0) && errno == ESRCH))
+         {                      // Stale
+            unlinkat (dfd, e->d_name, 0);
+            continue;
+         }
+         n++;
+      }
+      closedir (d);
+      return n;
+   }
+   int fd;
+   if (!ahead (1) && (fd = try ()) >= 0)
+   {                            // Nobody waiting, and a free slot
+      close (dfd);
+      return fd;
+   }
+   TRACE1 (render_wait_start, slots);
+   // Join queue
+   struct timespec start,
+     now;
+   clock_gettime (CLOCK_REALTIME, &start);
+   if (asprintf (&marker, "%s.q.%010ld.%09ld.%d", base, (long) start.tv_sec, start.tv_nsec, getpid ()) < 0)
+      errx (1, "malloc");
+   int m = openat (dfd, marker, O_CREAT | O_WRONLY, 0666);
+   if (m >= 0)
+      close (m);
+   *depth = ahead (1);
+   while (1)
+   {
+      if (!ahead (0) && (fd = try ()) >= 0)
+         break;
+      usleep (50000);
+   }
+   unlinkat (dfd, marker, 0);
+   close (dfd);
+   free (marker);
+   clock_gettime (CLOCK_REALTIME, &now);
+   *waited = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+   TRACE1 (render_wait_done, *depth);
+   return fd;
+}
+
+// Result cache (--cache-dir) - outputs are deterministic for the options and seed, so kept as files named by a hash
+// of them, hh...hh.ext, with .meta if there was one, and each part as hh...hh.part. Hits touch the file, and the
+// oldest are removed over the size
+
+/**
+ * Hashes a file's contents, so a loaded maze is in a cache key by what it is rather than its name.
+ *
+ * @param h Hash so far
+ * @param filename File, hashed as the name if it cannot be read
+ * @return Hash
+ */
+static unsigned long long
+fnv64_file (unsigned long long h, const char *filename)
+{
+   int i = open (filename, O_RDONLY);
+   if (i < 0)
+      return fnv64 (h, filename, strlen (filename));
+   char buf[65536];
+   ssize_t l;
+   while ((l = read (i, buf, sizeof (buf))) > 0)
+      h = fnv64 (h, buf, l);
+   close (i);
+   return h;
+}
+
+/**
+ * Copies a file to a file descriptor.
+ *
+ * @param from File to copy
+ * @param fd Where to write
+ * @return 0 on success
+ */
+static int
+copy_file (const char *from, int fd)
+{
+   int i = open (from, O_RDONLY);
+   if (i < 0)
+      return -1;
+   ssize_t l;
+#ifdef __linux__
+   while ((l = sendfile (fd, i, NULL, 1 << 30)) > 0);   // In the kernel, and to any fd
+   if (!l || (errno != EINVAL && errno != ENOSYS))
+   {
+      close (i);
+      return l;
+   }
+#endif
+   char buf[65536];
+   while ((l = read (i, buf, sizeof (buf))) > 0)
+      for (ssize_t d = 0, w; d < l; d += w)
+         if ((w = write (fd, buf + d, l - d)) <= 0)
+         {
+            close (i);
+            return -1;
+         }
+   close (i);
+   return l;
+}
+
+/**
+ * Makes somewhere to put SCAD for openscad - in memory where possible (memfd, named /proc/self/fd/N, which
+ * openscad reads as a file), else a temp file. See scad_temp_done.
+ *
+ * @param name Set to the name for openscad, room for 32 chars
+ * @param keep Set to the fd that keeps the memfd, which is not closed with the fd returned, or -1 for a temp file
+ * @return fd to write
+ */
+static int
+scad_temp (char *name, int *keep)
+{
+   int o = -1;
+   *keep = -1;
+#ifdef MFD_CLOEXEC
+   if ((o = memfd_create ("puzzlebox.scad", 0)) >= 0 && (*keep = dup (o)) >= 0)
+   {
+      sprintf (name, "/proc/self/fd/%d", *keep);
+      return o;
+   }
+   if (o >= 0)
+      close (o);
+#endif
+   strcpy (name, "/tmp/XXXXXX.scad");
+   if ((o = mkstemps (name, 5)) < 0)
+      err (1, "Cannot make temp");
+   return o;
+}
+
+/**
+ * Done with SCAD from scad_temp.
+ *
+ * @param name Name
+ * @param keep fd keeping the memfd, or -1 for a temp file
+ */
+static void
+scad_temp_done (const char *name, int keep)
+{
+   if (keep >= 0)
+      close (keep);
+   else
+      unlink (name);
+}
+
+/**
+ * Copies a file to a file descriptor, compressed by gzip or zstd (--compress), which are run as they are.
+ *
+ * @param from File to copy
+ * @param fd Where to write
+ * @param compress gzip or zstd, or NULL to copy as is
+ * @return 0 on success
+ */
+static int
+compress_file (const char *from, int fd, const char *compress)
+{
+   if (!compress)
+      return copy_file (from, fd);
+   int i = open (from, O_RDONLY);
+   if (i < 0)
+      return -1;
+   pid_t pid = fork ();
+   if (pid < 0)
+   {
+      close (i);
+      return -1;
+   }
+   if (!pid)
+   {                            // Child, -n so the same result compresses the same
+      if (dup2 (i, STDIN_FILENO) < 0 || dup2 (fd, STDOUT_FILENO) < 0)
+         _exit (1);
+      execlp (compress, compress, strcmp (compress, "gzip") ? "-cq" : "-cnq", NULL);
+      _exit (1);
+   }
+   close (i);
+   int status = 0;
+   if (waitpid (pid, &status, 0) < 0 || !WIFEXITED (status) || WEXITSTATUS (status))
+      return -1;
+   return 0;
+}
+
+/**
+ * Checks an HTTP Accept-Encoding list allows an encoding.
+ *
+ * @param list Accept-Encoding, or NULL
+ * @param enc Encoding
+ * @return 1 if allowed
+ */
+static int
+accepts_encoding (const char *list, const char *enc)
+{
+   size_t l = strlen (enc);
+   for (const char *p = list; p && *p;)
+   {
+      while (*p == ' ' || *p == ',')
+         p++;
+      const char *e = p;
+      while (*e && *e != ',' && *e != ';' && *e != ' ')
+         e++;
+      const char *c = strchr (e, ',') ? : e + strlen (e);
+      double q = 1;
+      for (const char *s = e; s < c; s++)
+         if (*s == ';')
+         {
+            while (s[1] == ' ')
+               s++;
+            if (s[1] == 'q' && s[2] == '=')
+               q = strtod (s + 3, NULL);
+         }
+      if (q > 0 && (((size_t) (e - p) == l && !strncasecmp (p, enc, l)) || (e - p == 1 && *p == '*')))
+         return 1;
+      p = c;
+   }
+   return 0;
+}
+
+/**
+ * Copies a file to another (not atomic).
+ *
+ * @param from File to copy
+ * @param to File to write
+ * @param compress gzip or zstd, or NULL to copy as is
+ * @return 0 on success
+ */
+static int
+copy_file_to (const char *from, const char *to, const char *compress)
+{
+   int o = open (to, O_CREAT | O_WRONLY | O_TRUNC, 0666);
+   if (o < 0)
+      return -1;
+   int e = compress_file (from, o, compress);
+   if (close (o))
+      e = -1;
+   return e;
+}
+
+/**
+ * Removes the least recently used files from the cache until it is no more than a size.
+ *
+ * @param dir Cache directory
+ * @param max Size (bytes)
+ */
+static void
+cache_trim (const char *dir, long long max)
+{
+   DIR *d = opendir (dir);
+   if (!d)
+      return;
+   struct entry
+   {
+      time_t mtime;
+      off_t size;
+      char *name;
+   } *e = NULL;
+   int n = 0,
+      a = 0;
+   long long total = 0;
+   struct dirent *de;
+   while ((de = readdir (d)))
+   {
+      struct stat st;
+      if (de->d_name[0] == '.' || fstatat (dirfd (d), de->d_name, &st, 0) || !S_ISREG (st.st_mode))
+         continue;
+      if (n == a && !(e = realloc (e, sizeof (*e) * (a = a * 2 + 64))))
+         errx (1, "malloc");
+      e[n++] = (struct entry) {.mtime = st.st_mtime,.size = st.st_size,.name = strdup (de->d_name) };
+      total += st.st_size;
+   }
+   int cmp (const void *a, const void *b)
+   {
+      time_t x = ((const struct entry *) a)->mtime,
+         y = ((const struct entry *) b)->mtime;
+      return x < y ? -1 : x > y;
+   }
+   qsort (e, n, sizeof (*e), cmp);
+   for (int i = 0; i < n; i++)
+   {
+      if (total > max && !unlinkat (dirfd (d), e[i].name, 0))
+         total -= e[i].size;
+      free (e[i].name);
+   }
+   free (e);
+   closedir (d);
+}
+
+// Server (--server) - a request is the environment a CGI would have, NAME=value lines then a blank line
+static const char *server_env[] = { "PATH_INFO", "QUERY_STRING", "HTTP_HOST", "REMOTE_ADDR", "HTTP_ACCEPT_ENCODING", NULL };
+
+static int urandom = -1;        // /dev/urandom, kept open by the server
+
+static void
+server_reap (int sig)
+{
+   (void) sig;
+   int e = errno;
+   while (waitpid (-1, NULL, WNOHANG) > 0);
+   errno = e;
+}
+
+/**
+ * Listens on a unix socket, and forks for each request - so each request starts from the options parsed once
+ * for the server (which are the defaults for the request), without exec, dynamic linking, or parsing again.
+ * Returns only in the child, with stdout the connection and the environment from the request.
+ *
+ * @param name Socket
+ */
+static void
+serve (const char *name)
+{
+   struct sockaddr_un a = {.sun_family = AF_UNIX };
+   if (strlen (name) >= sizeof (a.sun_path))
+      errx (1, "Socket name too long %s", name);
+   strcpy (a.sun_path, name);
+   int s = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   if (s < 0)
+      err (1, "socket");
+   unlink (name);
+   if (bind (s, (struct sockaddr *) &a, sizeof (a)) || listen (s, 64))
+      err (1, "Cannot listen on %s", name);
+   if ((urandom = open ("/dev/urandom", O_RDONLY)) < 0)
+      err (1, "Open /dev/random");
+   struct sigaction sa = {.sa_handler = server_reap,.sa_flags = SA_RESTART | SA_NOCLDSTOP };
+   sigaction (SIGCHLD, &sa, NULL);
+   while (1)
+   {
+      int c = accept (s, NULL, NULL);
+      if (c < 0)
+      {
+         if (errno == EINTR || errno == ECONNABORTED)
+            continue;
+         err (1, "accept");
+      }
+      pid_t pid = fork ();
+      if (pid < 0)
+         warn ("fork");
+      if (pid)
+      {
+         close (c);
+         continue;
+      }
+      // Child
+      signal (SIGCHLD, SIG_DFL);        // Renders are waited for
+      close (s);
+      for (int e = 0; server_env[e]; e++)
+         unsetenv (server_env[e]);
+      FILE *i = fdopen (dup (c), "r");
+      if (!i)
+         err (1, "fdopen");
+      char *line = NULL;
+      size_t len = 0;
+      ssize_t l;
+      while ((l = getline (&line, &len, i)) > 0)
+      {
+         while (l && (line[l - 1] == '\n' || line[l - 1] == '\r'))
+            line[--l] = 0;
+         if (!l)
+            break;
+         char *v = strchr (line, '=');
+         if (!v)
+            continue;
+         *v++ = 0;
+         for (int e = 0; server_env[e]; e++)
+            if (!strcmp (line, server_env[e]))
+               setenv (line, v, 1);
+      }
+      free (line);
+      fclose (i);
+      if (dup2 (c, STDOUT_FILENO) < 0)
+         err (1, "dup2");
+      close (c);
+      return;
+   }
+}
+
+/**
+ * Sends this request (PATH_INFO, QUERY_STRING, etc, as a CGI) to a --server, and copies the response to stdout.
+ *
+ * @param name Socket
+ * @return Exit status
+ */
+static int
+client (const char *name)
+{
+   struct sockaddr_un a = {.sun_family = AF_UNIX };
+   if (strlen (name) >= sizeof (a.sun_path))
+      errx (1, "Socket name too long %s", name);
+   strcpy (a.sun_path, name);
+   int s = socket (AF_UNIX, SOCK_STREAM, 0);
+   if (s < 0)
+      err (1, "socket");
+   if (connect (s, (struct sockaddr *) &a, sizeof (a)))
+      err (1, "Cannot connect to %s", name);
+   char *req = NULL;
+   size_t reqlen = 0;
+   FILE *f = open_memstream (&req, &reqlen);
+   if (!f)
+      err (1, "open_memstream");
+   for (int e = 0; server_env[e]; e++)
+   {
+      const char *v = getenv (server_env[e]);
+      if (v && !strchr (v, '\n'))
+         fprintf (f, "%s=%s\n", server_env[e], v);
+   }
+   fprintf (f, "\n");
+   fclose (f);
+   for (size_t d = 0; d < reqlen;)
+   {
+      ssize_t w = write (s, req + d, reqlen - d);
+      if (w <= 0)
+         err (1, "Cannot write to %s", name);
+      d += w;
+   }
+   free (req);
+   char buf[65536];
+   ssize_t l;
+   while ((l = read (s, buf, sizeof (buf))) > 0)
+      for (ssize_t d = 0, w; d < l; d += w)
+         if ((w = write (STDOUT_FILENO, buf + d, l - d)) <= 0)
+            err (1, "Cannot write output");
+   if (l < 0)
+      err (1, "Cannot read from %s", name);
+   close (s);
+   return 0;
+}
+
+// Jobs (--jobs) - one JSON object a line, option long names and values, e.g. {"seed":42,"core-diameter":20,"out-file":"42.scad"}
+/**
+ * Reads the jobs file, and forks for each job, at most slots at once - so the next job makes its mazes while the
+ * last is being written or rendered, all from the options parsed once (which are the defaults for each job).
+ * Returns only in the child, with the job line. The parent waits for all the jobs, and exits.
+ *
+ * @param name Jobs file (- for stdin)
+ * @param slots Jobs at once
+ * @param lineno Set to the job's line in the file
+ * @return The job line
+ */
+static char *
+jobs_run (const char *name, int slots, int *lineno)
+{
+   FILE *f = strcmp (name, "-") ? fopen (name, "r") : stdin;
+   if (!f)
+      err (1, "Cannot open %s", name);
+   if (slots < 1)
+      slots = 1;
+   // All read first, as the children share the file offset
+   char *all = NULL;
+   size_t alllen = 0;
+   FILE *m = open_memstream (&all, &alllen);
+   if (!m)
+      err (1, "open_memstream");
+   char buf[65536];
+   size_t l;
+   while ((l = fread (buf, 1, sizeof (buf), f)) > 0)
+      fwrite (buf, 1, l, m);
+   if (ferror (f))
+      err (1, "Cannot read %s", name);
+   if (f != stdin)
+      fclose (f);
+   fclose (m);
+   int running = 0,
+      failed = 0,
+      n = 0;
+   void reap (void)
+   {
+      int status;
+      if (waitpid (-1, &status, 0) <= 0)
+         err (1, "waitpid");
+      running--;
+      if (!WIFEXITED (status) || WEXITSTATUS (status))
+         failed++;
+   }
+   for (char *line = all, *next; line && *line; line = next)
+   {
+      n++;
+      if ((next = strchr (line, '\n')))
+         *next++ = 0;
+      while (isspace (*line))
+         line++;
+      if (!*line)
+         continue;
+      while (running >= slots)
+         reap ();
+      fflush (stdout);
+      fflush (stderr);
+      pid_t pid = fork ();
+      if (pid < 0)
+         err (1, "fork");
+      if (!pid)
+      {                         // Child
+         *lineno = n;
+         return line;
+      }
+      running++;
+   }
+   free (all);
+   while (running)
+      reap ();
+   if (failed)
+      errx (1, "%d job%s failed", failed, failed == 1 ? "" : "s");
+   exit (0);
+}
+
+/**
+ * Decodes a JSON string in place.
+ *
+ * @param pp At the opening quote, left after the closing quote
+ * @return The string, or NULL if bad
+ */
+static char *
+job_string (char **pp)
+{
+   char *p = *pp + 1,
+      *o = p,
+      *s = p;
+   while (*p != '"')
+   {
+      if ((unsigned char) *p < ' ')
+         return NULL;
+      if (*p != '\\')
+      {
+         *o++ = *p++;
+         continue;
+      }
+      p++;
+      switch (*p++)
+      {
+      case '"':
+      case '\\':
+      case '/':
+         *o++ = p[-1];
+         break;
+      case 'b':
+         *o++ = '\b';
+         break;
+      case 'f':
+         *o++ = '\f';
+         break;
+      case 'n':
+         *o++ = '\n';
+         break;
+      case 'r':
+         *o++ = '\r';
+         break;
+      case 't':
+         *o++ = '\t';
+         break;
+      case 'u':
+         {
+            unsigned int u = 0;
+            for (int i = 0; i < 4; i++, p++)
+            {
+               if (!isxdigit (*p))
+                  return NULL;
+               u = (u << 4) + (isalpha (*p) ? 9 : 0) + (*p & 0xF);
+            }
+            if (!u || (u >= 0xD800 && u < 0xE000))
+               return NULL;     // No NULs or surrogate pairs in file names and text
+            if (u < 0x80)
+               *o++ = u;
+            else if (u < 0x800)
+            {
+               *o++ = 0xC0 + (u >> 6);
+               *o++ = 0x80 + (u & 0x3F);
+            } else
+            {
+               *o++ = 0xE0 + (u >> 12);
+               *o++ = 0x80 + ((u >> 6) & 0x3F);
+               *o++ = 0x80 + (u & 0x3F);
+            }
+         }
+         break;
+      default:
+         return NULL;
+      }
+   }
+   *o = 0;
+   *pp = p + 1;
+   return s;
+}
+
+/**
+ * Sets the options from a job line, by long name against the option table - strings are left pointing in to the line.
+ *
+ * @param p Job line, a JSON object
+ * @param t Options
+ * @return Error, or NULL
+ */
+static const char *
+job_apply (char *p, const struct poptOption *t)
+{
+   while (isspace (*p))
+      p++;
+   if (*p++ != '{')
+      return "Not a JSON object";
+   while (isspace (*p))
+      p++;
+   if (*p == '}')
+      p++;
+   else
+      while (1)
+      {
+         if (*p != '"')
+            return "Expected option name";
+         char *key = job_string (&p);
+         if (!key)
+            return "Bad option name";
+         while (isspace (*p))
+            p++;
+         if (*p++ != ':')
+            return "Expected :";
+         while (isspace (*p))
+            p++;
+         char *v;
+         int quoted = (*p == '"');
+         if (quoted)
+         {
+            if (!(v = job_string (&p)))
+               return "Bad string";
+         } else
+         {                      // Number, true or false
+            char *e = p;
+            while (isalnum (*e) || *e == '-' || *e == '+' || *e == '.')
+               e++;
+            if (e == p)
+               return "Expected value";
+            v = strndup (p, e - p);
+            if (!v)
+               errx (1, "malloc");
+            p = e;
+         }
+         int o;
+         for (o = 0; t[o].longName && strcmp (t[o].longName, key); o++);
+         if (!t[o].longName || !t[o].arg)
+         {
+            char *error = NULL;
+            if (asprintf (&error, "Unknown option [%s]", key) < 0)
+               errx (1, "malloc");
+            return error;
+         }
+         char *e = v;
+         switch (t[o].argInfo & POPT_ARG_MASK)
+         {
+         case POPT_ARG_NONE:
+            if (!quoted && !strcmp (v, "true"))
+               *(int *) t[o].arg = 1;
+            else if (!quoted && !strcmp (v, "false"))
+               *(int *) t[o].arg = 0;
+            else
+               return "Expected true or false";
+            break;
+         case POPT_ARG_INT:
+            *(int *) t[o].arg = strtol (v, &e, 10);
+            if (!*v || *e)
+               return "Expected whole number";
+            break;
+         case POPT_ARG_DOUBLE:
+            *(double *) t[o].arg = strtod (v, &e);
+            if (!*v || *e)
+               return "Expected number";
+            break;
+         case POPT_ARG_STRING:
+            if (!quoted && (!strcmp (v, "true") || !strcmp (v, "false")))
+               return "Expected string";
+            *(char **) t[o].arg = v;
+            break;
+         }
+         while (isspace (*p))
+            p++;
+         if (*p == '}')
+         {
+            p++;
+            break;
+         }
+         if (*p++ != ',')
+            return "Expected , or }";
+         while (isspace (*p))
+            p++;
+      }
+   while (isspace (*p))
+      p++;
+   if (*p)
+      return "Extra after JSON object";
+   return NULL;
+}
+
+/**
+ * Makes a box - the puzzle box generator, from the main entry point or the library.
  * Parses command line arguments, validates parameters, generates OpenSCAD code
  * for 3D-printable cylindrical maze puzzle boxes, and optionally converts to STL.
+ * With a sink the box is made as native meshes (as --stl --native), and each mesh goes to the sink rather than a file.
  * 
  * @param argc Number of command line arguments
  * @param argv Array of command line argument strings
+ * @param sink Sink for the meshes, or NULL
+ * @param ctx Passed to the sink
  * @return 0 on success, 1 on error
  */
 int
-main (int argc, const char *argv[])
+pb_box (int argc, const char *argv[], pb_mesh_sink_t * sink, void *ctx)
 {
+   stage (STAGE_PARSE);
+   memset (stage_wall, 0, sizeof (stage_wall));        // From the start of this box, if more than one is made
+   memset (stage_cpu, 0, sizeof (stage_cpu));
    double basethickness = 1.6;
    double basegap = 0.4;
    double baseheight = 10;
@@ -98,6 +1987,12 @@ main (int argc, const char *argv[])
    int webform = 0;
    int parkvertical = 0;
    int mazecomplexity = 5;
+   int candidates = 1;          // Mazes to make for each part, best is used
+   int keep = 1;                // Best candidates to keep (saved with save-maze)
+   int threads = 0;             // Threads for candidates, 0 for one per core
+   int minsolution = 0;         // Targets for the mazes, 0 for none (see pb_params_t)
+   int maxvertical = 0;
+   int minchoices = 0;
    int mirrorinside = 0;        // Clockwise lock on inside - may be unwise as more likely to come undone with outer.
    int fixnubs = 0;             // Fix nub position opposite maze exit
    double globalexit = 0;       // Global maze exit angle (for fix-nubs across all parts)
@@ -107,16 +2002,32 @@ main (int argc, const char *argv[])
    int noa = 0;
    int basewide = 0;
    int stl = 0;
+   int native = 0;
+   int nativestatic = 0;        // Parts that are not polyhedra rendered by openscad once and kept
+   int preview = 0;             // Quick, rough, preview
+   const char *annotations = NULL;      // none, compact, full
+   int timings = 0;
+   const char *stats = NULL;    // text, json
+   int renderslots = 1;         // Concurrent openscad renders on this host
+   int renderparts = 0;         // Render each part on its own
+   int rendermemory = 0;        // Memory limit (MB) per openscad render
+   const char *renderlock = "/var/lock/puzzlebox";
+   const char *cachedir = NULL; // Cache of results
+   int cachesize = 1024;        // Cache size (MB)
    int resin = 0;
    const char *outfile = NULL;
+   const char *compress = NULL; // Compress the output, gzip or zstd
    const char *loadmazeinside = NULL;  // File to load inside maze from
    const char *loadmazeoutside = NULL; // File to load outside maze from
    const char *savemazeinside = NULL;  // File to save inside maze to
    const char *savemazeoutside = NULL; // File to save outside maze to
+   const char *mazejson = NULL; // File to write mazes, solutions and part sizes to
+   const char *server = NULL;   // Socket to serve requests on
+   const char *clientof = NULL; // Socket to send this request to
+   const char *jobs = NULL;     // File of jobs to run
 
-   int f = open ("/dev/urandom", O_RDONLY);
-   if (f < 0)
-      err (1, "Open /dev/random");
+   int seed = 0;                // Random seed, 0 to pick one
+   pb_rng_t rng;
 
    char pathsep = 0;
    char *path = getenv ("PATH_INFO");
@@ -127,6 +2038,10 @@ main (int argc, const char *argv[])
 
    const struct poptOption optionsTable[] = {
       {"stl", 'l', POPT_ARG_NONE, &stl, 0, "Run output through openscad to make stl (may take a few seconds)"},
+      {"native", 0, POPT_ARG_NONE, &native, 0, "Make stl (or 3mf if out-file is .3mf) directly, without openscad, where possible"},
+      {"native-static", 0, POPT_ARG_NONE, &nativestatic, 0,
+       "With --native and --cache-dir, render the bases, grips and text with openscad once and keep them, making only the mazes and nubs each time"},
+      {"preview", 'P', POPT_ARG_NONE, &preview, 0, "Quick preview, with coarse curves and a plain base, and no grips, text or logo"},
       {"resin", 'R', POPT_ARG_NONE, &resin, 0, "Half all specified clearances for resin printing"},
       {"parts", 'm', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT, &parts, 0, "Total parts", "N"},
       {"core-diameter", 'c', POPT_ARG_DOUBLE | POPT_ARGFLAG_SHOW_DEFAULT, &corediameter, 0, "Core diameter for content", "mm"},
@@ -139,6 +2054,7 @@ main (int argc, const char *argv[])
       {"text-side", 'S', POPT_ARG_STRING | (textsides ? POPT_ARGFLAG_SHOW_DEFAULT : 0), &textsides, 0, "Text on sides",
        "Text{\\Text...}"},
       {"part", 'n', POPT_ARG_INT, &part, 0, "Which part to make", "N (0 for all)"},
+      {"seed", 'u', POPT_ARG_INT, &seed, 0, "Random seed, same seed makes same mazes", "N (0 for random)"},
       {"inside", 'i', POPT_ARG_NONE, &inside, 0, "Maze on inside (hard)"},
       {"flip", 'f', POPT_ARG_NONE, &flip, 0, "Alternating inside/outside maze"},
       {"flip-stagger", '\0', POPT_ARG_NONE, &flip_stagger, 0, "Mazes on even parts, nubs on odd parts (opposite of --flip)"},
@@ -153,6 +2069,12 @@ main (int argc, const char *argv[])
       {"top-space", 'T', POPT_ARG_DOUBLE | (topspace ? POPT_ARGFLAG_SHOW_DEFAULT : 0), &topspace, 0, "Extra space above maze top (exit remains at top)", "mm"},
       {"maze-complexity", 'X', POPT_ARG_INT | (mazecomplexity ? POPT_ARGFLAG_SHOW_DEFAULT : 0), &mazecomplexity, 0,
        "Maze complexity", "-10 to 10"},
+      {"candidates", 0, POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT, &candidates, 0, "Make this many mazes for each part and use the best (see scoring.md)", "N"},
+      {"keep", 0, POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT, &keep, 0, "Best candidates to keep, saved as file.2, file.3... (file.2.pbmz...) with save-maze", "N"},
+      {"threads", 0, POPT_ARG_INT, &threads, 0, "Threads to make candidates", "N (0 for one per core)"},
+      {"min-solution", 0, POPT_ARG_INT, &minsolution, 0, "Make mazes with a solution of at least this many cells (see scoring.md)", "N"},
+      {"max-vertical", 0, POPT_ARG_INT, &maxvertical, 0, "Make mazes with no vertical run longer than this", "N"},
+      {"min-choices", 0, POPT_ARG_INT, &minchoices, 0, "Make mazes with at least this many cells on the solution with a way off it", "N"},
       {"park-thickness", 'p', POPT_ARG_DOUBLE | (parkthickness ? POPT_ARGFLAG_SHOW_DEFAULT : 0), &parkthickness, 0,
        "Thickness of park ridge to click closed", "mm"},
       {"park-vertical", 'v', POPT_ARG_NONE, &parkvertical, 0, "Park vertically"},
@@ -194,10 +2116,24 @@ main (int argc, const char *argv[])
       {"no-a", 0, POPT_ARG_NONE | (noa ? POPT_ARGFLAG_DOC_HIDDEN : 0), &noa, 0, "No A"},
       {"web-form", 0, POPT_ARG_NONE, &webform, 0, "Web form"},
       {"out-file", 0, POPT_ARG_STRING, &outfile, 0, "Output to file", "filename"},
-      {"load-maze-inside", 0, POPT_ARG_STRING, &loadmazeinside, 0, "Load pre-generated inside maze from file", "filename"},
-      {"load-maze-outside", 0, POPT_ARG_STRING, &loadmazeoutside, 0, "Load pre-generated outside maze from file", "filename"},
-      {"save-maze-inside", 0, POPT_ARG_STRING, &savemazeinside, 0, "Save generated inside maze to file", "filename"},
-      {"save-maze-outside", 0, POPT_ARG_STRING, &savemazeoutside, 0, "Save generated outside maze to file", "filename"},
+      {"compress", 0, POPT_ARG_STRING, &compress, 0, "Compress the output (and .meta), for the web only if HTTP_ACCEPT_ENCODING allows", "gzip|zstd"},
+      {"timings", 0, POPT_ARG_NONE, &timings, 0, "Report the time for each stage, and the points, faces and SCAD bytes made, on stderr"},
+      {"stats", 0, POPT_ARG_STRING, &stats, 0, "Report counters from making the mazes and SCAD, and the stage times, on stderr", "text|json"},
+      {"annotations", 0, POPT_ARG_STRING, &annotations, 0, "Maze comments in SCAD: none, compact (one line a maze), full (default, but none for stl)", "none|compact|full"},
+      {"load-maze-inside", 0, POPT_ARG_STRING, &loadmazeinside, 0, "Load pre-generated inside maze from file (text, .pbmz, or .pbmc collection with #N)", "filename"},
+      {"load-maze-outside", 0, POPT_ARG_STRING, &loadmazeoutside, 0, "Load pre-generated outside maze from file (text, .pbmz, or .pbmc collection with #N)", "filename"},
+      {"save-maze-inside", 0, POPT_ARG_STRING, &savemazeinside, 0, "Save generated inside maze to file (binary if .pbmz)", "filename"},
+      {"save-maze-outside", 0, POPT_ARG_STRING, &savemazeoutside, 0, "Save generated outside maze to file (binary if .pbmz)", "filename"},
+      {"server", 0, POPT_ARG_STRING, &server, 0, "Serve requests on a unix socket, forking for each, with these options as the defaults", "socket"},
+      {"client", 0, POPT_ARG_STRING, &clientof, 0, "Send this request (PATH_INFO or QUERY_STRING, as a CGI) to a server and output the response", "socket"},
+      {"jobs", 0, POPT_ARG_STRING, &jobs, 0, "Run a job for each line (JSON object of options, with out-file), forking for each, one more at once than render-slots, with these options as the defaults", "filename"},
+      {"maze-json", 0, POPT_ARG_STRING, &mazejson, 0, "Write the mazes, solutions and part sizes to file as JSON", "filename"},
+      {"render-slots", 0, POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT, &renderslots, 0, "Concurrent openscad renders allowed on this host", "N"},
+      {"render-memory", 0, POPT_ARG_INT, &rendermemory, 0, "Memory limit for each openscad render", "MB"},
+      {"render-parts", 0, POPT_ARG_NONE, &renderparts, 0, "Render each part on its own, at once up to render-slots, and merge (stl, 3mf or zip out-file)"},
+      {"render-lock", 0, POPT_ARG_STRING | POPT_ARGFLAG_SHOW_DEFAULT, &renderlock, 0, "Lock file for render slots (.N added for more slots)", "filename"},
+      {"cache-dir", 0, POPT_ARG_STRING, &cachedir, 0, "Keep results in this directory, and use them for the same options and seed (if --seed is set)", "directory"},
+      {"cache-size", 0, POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT, &cachesize, 0, "Cache size, least recently used removed", "MB"},
       POPT_AUTOHELP {}
    };
 
@@ -219,6 +2155,43 @@ main (int argc, const char *argv[])
       poptFreeContext (optCon);
    }
 
+   if (sink)
+   {                            // Meshes for the library, not files
+      if (jobs || server || clientof)
+         errx (1, "No jobs, server or client making meshes for a sink");
+      stl = native = 1;
+      nativestatic = 0;
+      outfile = cachedir = compress = NULL;
+   }
+   if (jobs)
+   {                            // Returns in a child for each job
+      int lineno = 0;
+      const char *name = jobs;
+      char *job = jobs_run (name, renderslots + 1, &lineno);
+      jobs = outfile = NULL;
+      const char *e = job_apply (job, optionsTable);
+      if (e)
+         errx (1, "%s:%d: %s", name, lineno, e);
+      if (!outfile)
+         errx (1, "%s:%d: No out-file", name, lineno);
+      if (jobs || server || clientof)
+         errx (1, "%s:%d: No jobs, server or client in a job", name, lineno);
+   }
+   if (clientof)
+      return client (clientof);
+   if (server)
+   {                            // Returns in a child for each request
+      serve (server);
+      server = NULL;
+      if (getenv ("HTTP_HOST"))
+         mime = 1;
+      pathsep = 0;
+      if ((path = getenv ("PATH_INFO")))
+         pathsep = '/';
+      else if ((path = getenv ("QUERY_STRING")))
+         pathsep = '&';
+   }
+
    if (resin)
    {                            // Lower clearances for resin print
       basegap /= 2;
@@ -349,6 +2322,11 @@ main (int argc, const char *argv[])
                      l = -10;
                      h = 10;
                   }
+                  if (optionsTable[o].shortName == 'u')
+                  {             // Seed, too many to list
+                     printf ("<input size='10' name='%c' id='%c'/>", optionsTable[o].shortName, optionsTable[o].shortName);
+                     break;
+                  }
                   printf ("<select name='%c' id='%c'>", optionsTable[o].shortName, optionsTable[o].shortName);
                   for (; l <= h; l++)
                      printf ("<option value='%d'%s>%d</option>", l, l == v ? " selected" : "", l);
@@ -394,7 +2372,41 @@ main (int argc, const char *argv[])
       return 0;
    }
 
+   int seeded = (seed != 0);    // Seed given, so the result is repeatable and can be cached
+   if (!seed)
+   {                            // Pick a seed, it is then reported in the args, file name, and meta, so the box can be made again
+      int f = (urandom >= 0 ? urandom : open ("/dev/urandom", O_RDONLY));
+      if (f < 0)
+         err (1, "Open /dev/random");
+      if (read (f, &seed, sizeof (seed)) != sizeof (seed))
+         err (1, "Read /dev/random");
+      if (f != urandom)
+         close (f);
+      seed &= 0x7FFFFFFF;
+      if (!seed)
+         seed = 1;
+   }
+
+   stage (STAGE_OTHER);
    // Sanity checks and adjustments
+   enum
+   { ANNOTATE_NONE, ANNOTATE_COMPACT, ANNOTATE_FULL };
+   int annotate = (stl ? ANNOTATE_NONE : ANNOTATE_FULL);        // The SCAD for stl is only for openscad
+   if (stats && strcmp (stats, "text") && strcmp (stats, "json"))
+      errx (1, "--stats is text or json");
+   if (compress && strcmp (compress, "gzip") && strcmp (compress, "zstd"))
+      errx (1, "--compress is gzip or zstd");
+   if (annotations)
+   {
+      if (!strcmp (annotations, "none"))
+         annotate = ANNOTATE_NONE;
+      else if (!strcmp (annotations, "compact"))
+         annotate = ANNOTATE_COMPACT;
+      else if (!strcmp (annotations, "full"))
+         annotate = ANNOTATE_FULL;
+      else
+         errx (1, "--annotations is none, compact or full");
+   }
    /**
     * Normalizes text input by replacing double quotes with single quotes.
     * Used to sanitize user-provided text for safe inclusion in OpenSCAD output.
@@ -453,6 +2465,13 @@ main (int argc, const char *argv[])
       textdepth = 0;
    if (coresolid && coregap < mazestep * 2)
       coregap = mazestep * 2;
+   int fnscale = 4;             // Segments for each maze cell around, for cylinders
+   if (preview)
+   {                            // The same size, without what takes openscad the time
+      fnscale = 1;
+      gripdepth = 0;
+      textslow = 0;
+   }
 
    // Pre-calculate size data for all parts
    double part_r0s[parts + 1];
@@ -461,6 +2480,9 @@ main (int argc, const char *argv[])
    double part_r3s[parts + 1];
    double part_entryas[parts + 1];
    double part_mazeexits[parts + 1];
+   memset (part_entryas, 0, sizeof (part_entryas));
+   memset (part_mazeexits, 0, sizeof (part_mazeexits));
+   int lastinside = 0;          // Last part has maze inside
    for (int p = 1; p <= parts; p++)
    {
       int mazeinside = inside;
@@ -499,6 +2521,8 @@ main (int argc, const char *argv[])
          nextoutside = 0;
       if (p == parts)
          nextinside = 0;
+      if (p == parts)
+         lastinside = mazeinside;
       double r1 = corediameter / 2 + wallthickness + (p - 1) * (wallthickness + mazethickness + clearance);  // Outer
       if (coresolid)
          r1 -= wallthickness + mazethickness + clearance - (inside ? mazethickness : 0);        // Adjust to make part 2 the core diameter
@@ -530,10 +2554,13 @@ main (int argc, const char *argv[])
    int markpos0 = (outersides && outersides / nubs * nubs != outersides);       // Mark on position zero for alignment
    double nubskew = (symmectriccut ? 0 : mazestep / 8); // Skew the shape of the cut
 
-   // MIME header
-   if (mime)
+   /**
+    * Writes the options that are set, by short name, as used for the file name.
+    *
+    * @param f Output
+    */
+   void argname (FILE * f)
    {
-      printf ("Content-Type: %s\r\nContent-Disposition: Attachment; filename=puzzlebox", stl ? "model/stl" : "application/scad");
       int o;
       for (o = 0; optionsTable[o].longName; o++)
          if (optionsTable[o].shortName && optionsTable[o].arg)
@@ -542,12 +2569,12 @@ main (int argc, const char *argv[])
             case POPT_ARG_NONE:
                if (!*(int *) optionsTable[o].arg)
                   break;
-               printf ("-%c", optionsTable[o].shortName);
+               fprintf (f, "-%c", optionsTable[o].shortName);
                break;
             case POPT_ARG_INT:
                if (!*(int *) optionsTable[o].arg)
                   break;
-               printf ("-%d%c", *(int *) optionsTable[o].arg, optionsTable[o].shortName);
+               fprintf (f, "-%d%c", *(int *) optionsTable[o].arg, optionsTable[o].shortName);
                break;
             case POPT_ARG_DOUBLE:
                if (!*(double *) optionsTable[o].arg)
@@ -561,7 +2588,7 @@ main (int argc, const char *argv[])
                p = strchr (temp, '.');
                if (*p)
                   *p++ = 0;
-               printf ("-%s%c%s", temp, optionsTable[o].shortName, p);
+               fprintf (f, "-%s%c%s", temp, optionsTable[o].shortName, p);
                break;
             case POPT_ARG_STRING:
                if (!*(char **) optionsTable[o].arg)
@@ -573,24 +2600,148 @@ main (int argc, const char *argv[])
                      if (*q <= ' ' || *q == '/' || *q == '\\' || *q == '"' || *q == '\'' || *q == ':' || *q == ';')
                         *q = '_';
                   *q = 0;
-                  printf ("-%c%s", optionsTable[o].shortName, p);
+                  fprintf (f, "-%c%s", optionsTable[o].shortName, p);
                }
                break;
             }
+   }
+
+   // MIME header
+   if (mime)
+   {
+      if (compress && getenv ("HTTP_HOST"))
+      {                         // What the browser takes, else gzip, else none
+         const char *accept = getenv ("HTTP_ACCEPT_ENCODING");
+         if (!accepts_encoding (accept, compress))
+            compress = (accepts_encoding (accept, "gzip") ? "gzip" : NULL);
+      }
+      printf ("Content-Type: %s\r\n", stl ? "model/stl" : "application/scad");
+      if (compress)
+         printf ("Content-Encoding: %s\r\n", compress);
+      printf ("Content-Disposition: Attachment; filename=puzzlebox");
+      argname (stdout);
       printf (".%s\r\n\r\n", stl ? "stl" : "scad");     // Used from apache
       fflush (stdout);
    }
 
-   FILE *out = stdout;
-   char tmp[] = "/tmp/XXXXXX.scad";
-   if (stl)
+   /**
+    * Hashes the options that make the result (part 0), or a part, for the cache.
+    * For the result, the options as in the file name, and the rest exactly. For a part, all of them, except
+    * those only used for another part, and those that make the same part in a different place (see makepart).
+    * Options that do not change what is made (threads, output, rendering) are not included.
+    *
+    * @param part Part, 0 for the result
+    * @return Hash
+    */
+   unsigned long long cachekey (int part)
+   {
+      char *key = NULL;
+      size_t keylen = 0;
+      FILE *f = open_memstream (&key, &keylen);
+      if (!f)
+         err (1, "open_memstream");
+      if (!part)
+         argname (f);
+      for (int o = 0; optionsTable[o].longName; o++)
+      {
+         const char *l = optionsTable[o].longName;
+         if (!optionsTable[o].arg || !strcmp (l, "threads") || !strcmp (l, "mime") || !strcmp (l, "out-file")
+             || !strcmp (l, "compress")             || !strncmp (l, "render-", 7) || !strncmp (l, "cache-", 6))
+            continue;
+         if (!part && optionsTable[o].shortName && (optionsTable[o].argInfo & POPT_ARG_MASK) != POPT_ARG_STRING)
+            continue;           // In the name (strings are not exact in the name)
+         if (part && (!strcmp (l, "part") || (part < parts && (!strncmp (l, "text-side", 9) || !strcmp (l, "text-font")
+                                                                || !strcmp (l, "text-outset")))))
+            continue;           // Side text is only on the outer part
+         switch (optionsTable[o].argInfo & POPT_ARG_MASK)
+         {
+         case POPT_ARG_NONE:
+         case POPT_ARG_INT:
+            fprintf (f, " %s=%d", l, *(int *) optionsTable[o].arg);
+            break;
+         case POPT_ARG_DOUBLE:
+            fprintf (f, " %s=%a", l, *(double *) optionsTable[o].arg);
+            break;
+         case POPT_ARG_STRING:
+            if (*(char **) optionsTable[o].arg)
+               fprintf (f, " %s=%s", l, *(char **) optionsTable[o].arg);
+            break;
+         }
+      }
+      fclose (f);
+      unsigned long long h = fnv64 (14695981039346656037ULL, key, keylen);
+      free (key);
+      if (loadmazeinside)
+         h = fnv64_file (h, loadmazeinside);
+      if (loadmazeoutside)
+         h = fnv64_file (h, loadmazeoutside);
+      return h;
+   }
+
+   // Result cache, or compression - made in a temp file (cachetmp) and copied to where it goes (cacheout), compressed
+   const char *cacheout = outfile;      // Where the result goes, NULL for stdout, when output is to a temp file
+   char *cachefile = NULL,
+      *cachetmp = NULL;
+   size_t extlen = (outfile ? strlen (outfile) : 0);
+   if (compress && extlen > 3 && !strcasecmp (outfile + extlen - 3, ".gz"))
+      extlen -= 3;              // x.3mf.gz is 3mf
+   else if (compress && extlen > 4 && !strcasecmp (outfile + extlen - 4, ".zst"))
+      extlen -= 4;
+   const char *ext = (extlen > 4 ? outfile + extlen - 4 : "");
+   ext = (!strncasecmp (ext, ".3mf", 4) ? "3mf" : !strncasecmp (ext, ".zip", 4) ? "zip" : stl ? "stl" : "scad");
+   if (cachedir && seeded && !savemazeinside && !savemazeoutside && !mazejson)
    {
-      int o = mkstemps (tmp, 5);
+      unsigned long long h = cachekey (0);
+      if (asprintf (&cachefile, "%s/%016llx.%s", cachedir, h, ext) < 0
+          || asprintf (&cachetmp, "%s/%016llx.%d.%s", cachedir, h, getpid (), ext) < 0)
+         errx (1, "malloc");
+      if (!access (cachefile, R_OK))
+      {                         // Hit
+         utimensat (AT_FDCWD, cachefile, NULL, 0);      // Recently used
+         if (cacheout)
+         {
+            if (copy_file_to (cachefile, cacheout, compress))
+               err (1, "Cannot write %s", cacheout);
+            char *from = NULL,
+               *to = NULL;
+            if (asprintf (&from, "%s.meta", cachefile) < 0
+                || asprintf (&to, "%.*s.meta%s", (int) extlen, cacheout, cacheout + extlen) < 0)
+               errx (1, "malloc");
+            if (!access (from, R_OK) && copy_file_to (from, to, compress))
+               err (1, "Cannot write %s", to);
+            free (from);
+            free (to);
+         } else if (compress_file (cachefile, STDOUT_FILENO, compress))
+            err (1, "Cannot write output");
+         free (cachefile);
+         free (cachetmp);
+         return 0;
+      }
+      outfile = cachetmp;       // Make in the cache and copy when done
+   } else if (compress)
+   {                            // Make in a temp file and compress when done
+      if (asprintf (&cachetmp, "/tmp/XXXXXX.%s", ext) < 0)
+         errx (1, "malloc");
+      int o = mkstemps (cachetmp, strlen (ext) + 1);
       if (o < 0)
          err (1, "Cannot make temp");
-      out = fdopen (o, "w");
-   } else if (outfile && !(out = fopen (outfile, "w")))
+      close (o);
+      outfile = cachetmp;
+   }
+
+   FILE *out = stdout;
+   char tmp[32];                // SCAD for openscad, if stl
+   int tmpkeep = -1;
+   if (sink && !(out = fopen ("/dev/null", "w")))
+      err (1, "Cannot open /dev/null");
+   else if (stl && !sink)
+      out = fdopen (scad_temp (tmp, &tmpkeep), "w");
+   else if (outfile && !(out = fopen (outfile, "w")))
       err (1, "Cannot open %s", outfile);
+   counted_t scad = { out, 0 };
+   if (!(out = fopencookie (&scad, "w", (cookie_io_functions_t) {.write = counted_write })))
+      err (1, "fopencookie");
+   setvbuf (out, NULL, scad.f == stdout && isatty (fileno (scad.f)) ? _IOLBF : _IOFBF, OUTBUF);
 
    fprintf (out, "// Puzzlebox by RevK, @TheRealRevK www.me.uk\n");
    fprintf (out, "// Thingiverse examples and instructions https://www.thingiverse.com/thing:2410748\n");
@@ -653,11 +2804,12 @@ main (int argc, const char *argv[])
    basethickness += logodepth;
 
    {                            // Modules
-      if (textslow)
+      if (textslow)             // Stepped offsets rather than a minkowski with a cone, which is the slow bit of a render
          fprintf
             (out,
-             "module cuttext(){translate([0,0,-%lld])minkowski(){rotate([0,0,22.5])cylinder(h=%lld,d1=%lld,d2=0,$fn=8);linear_extrude(height=%lld,convexity=10)mirror([1,0,0])children();}}\n",
-             SCALE, scaled (textdepth), scaled (textdepth), SCALE);
+             "module cuttext(){translate([0,0,-%lld])linear_extrude(height=%lld,convexity=10)offset(r=%lld,$fn=8)mirror([1,0,0])children();for(i=[0:%d])translate([0,0,i*%lld])linear_extrude(height=%lld,convexity=10)offset(r=%lld*(%d-i-0.5)/%d,$fn=8)mirror([1,0,0])children();}\n",
+             SCALE, SCALE, scaled (textdepth) / 2, TEXTSTEPS - 1, scaled (textdepth) / TEXTSTEPS,
+             scaled (textdepth) / TEXTSTEPS, scaled (textdepth) / 2, TEXTSTEPS, TEXTSTEPS);
       else
          fprintf (out, "module cuttext(){linear_extrude(height=%lld,convexity=10,center=true)mirror([1,0,0])children();}\n",
                   scaled (textdepth));
@@ -668,226 +2820,6 @@ main (int argc, const char *argv[])
             (out,
              "module logo(w=100,white=0,$fn=100){scale(w/100){if(!white)difference(){circle(d=100.5);circle(d=99.5);}difference(){if(white)circle(d=100);difference(){circle(d=92);for(m=[0,1])mirror([m,0,0]){difference(){translate([24,0,0])circle(r=22.5);translate([24,0,0])circle(r=15);}polygon([[1.5,22],[9,22],[9,-18.5],[1.5,-22]]);}}}}} // A&A Logo is copyright (c) 2013 and trademark Andrews & Arnold Ltd\n");
    }
-   /**
-    * Saves a generated maze to a file in human-readable text format.
-    * File format:
-    *   PUZZLEBOX_MAZE v1.0
-    *   WIDTH <W>
-    *   HEIGHT <H>
-    *   DATA
-    *   <hex bytes, one row per line>
-    *   END
-    * 
-    * @param filename Path to output file
-    * @param maze Pointer to maze array data
-    * @param W Width of maze (number of cells around circumference)
-    * @param H Height of maze (number of cells vertically)
-    */
-   void save_maze (const char *filename, unsigned char *maze, int W, int H, int entry_x, int helix_val)
-   {
-      FILE *f = fopen (filename, "w");
-      if (!f)
-         err (1, "Cannot open maze file for writing: %s", filename);
-      
-      // Write header
-      fprintf (f, "PUZZLEBOX_MAZE v1.1\n");
-      fprintf (f, "WIDTH %d\n", W);
-      fprintf (f, "HEIGHT %d\n", H);
-      fprintf (f, "HELIX %d\n", helix_val);
-      fprintf (f, "EXIT_X %d\n", entry_x);
-      fprintf (f, "DATA\n");
-      
-      // Write maze data as hex, one row per line
-      for (int y = 0;y < H; y++)
-      {
-         for (int x = 0; x < W; x++)
-         {
-            fprintf (f, "%02X", maze[x * H + y]);
-            if (x < W - 1)
-               fprintf (f, " ");
-         }
-         fprintf (f, "\n");
-      }
-      
-      fprintf (f, "END\n");
-      fclose (f);
-   }
-
-   /**
-    * Loads a pre-generated maze from a file in human-readable text format.
-    * File format:
-    *   PUZZLEBOX_MAZE v1.1
-    *   WIDTH <W>
-    *   HEIGHT <H>
-    *   HELIX <helix>
-    *   EXIT_X <X>
-    *   DATA
-    *   <hex bytes, one row per line>
-    *   END
-    * 
-    * @param filename Path to input file
-    * @param maze Pointer to maze array to populate (must be pre-allocated)
-    * @param expected_W Expected width (0 to accept any width)
-    * @param expected_H Expected height (0 to accept any height)
-    * @param actual_W Pointer to store actual width read from file
-    * @param actual_H Pointer to store actual height read from file
-    * @param entry_x Pointer to store entry X position from file (can be NULL if not needed)
-    * @param helix_val Pointer to store helix value from file (can be NULL if not needed)
-    * @return 0 on success, 1 on error
-    */
-   int load_maze (const char *filename, unsigned char *maze, int expected_W, int expected_H, int *actual_W, int *actual_H, int *entry_x, int *helix_val)
-   {
-      FILE *f = fopen (filename, "r");
-      if (!f)
-      {
-         warn ("Cannot open maze file for reading: %s", filename);
-         return 1;
-      }
-      
-      char line[16384];
-      int W = 0, H = 0, X = 0, helix = 0;
-      int file_version = 0;  // 0=v1.0 (no helix), 1=v1.1 (with helix)
-      
-      // Read and validate header
-      if (!fgets (line, sizeof (line), f))
-      {
-         fclose (f);
-         warnx ("Cannot read header from %s", filename);
-         return 1;
-      }
-      
-      if (strncmp (line, "PUZZLEBOX_MAZE v1.1", 19) == 0)
-         file_version = 1;
-      else if (strncmp (line, "PUZZLEBOX_MAZE v1.0", 19) == 0)
-         file_version = 0;
-      else
-      {
-         fclose (f);
-         warnx ("Invalid maze file header in %s", filename);
-         return 1;
-      }
-      
-      // Read WIDTH
-      if (!fgets (line, sizeof (line), f) || sscanf (line, "WIDTH %d", &W) != 1 || W <= 0)
-      {
-         fclose (f);
-         warnx ("Invalid or missing WIDTH in %s", filename);
-         return 1;
-      }
-      
-      // Read HEIGHT
-      if (!fgets (line, sizeof (line), f) || sscanf (line, "HEIGHT %d", &H) != 1 || H <= 0)
-      {
-         fclose (f);
-         warnx ("Invalid or missing HEIGHT in %s", filename);
-         return 1;
-      }
-      
-      // Read HELIX (only in v1.1)
-      if (file_version >= 1)
-      {
-         if (!fgets (line, sizeof (line), f) || sscanf (line, "HELIX %d", &helix) != 1)
-         {
-            fclose (f);
-            warnx ("Invalid or missing HELIX in v1.1 file %s", filename);
-            return 1;
-         }
-      }
-      
-      // Read EXIT_X (optional for backward compatibility with old ENTRY_X format)
-      if (fgets (line, sizeof (line), f))
-      {
-         if (sscanf (line, "EXIT_X %d", &X) == 1 || sscanf (line, "ENTRY_X %d", &X) == 1)
-         {
-            // Successfully read EXIT_X (or legacy ENTRY_X), now read the next line which should be DATA
-            if (!fgets (line, sizeof (line), f) || strncmp (line, "DATA", 4) != 0)
-            {
-               fclose (f);
-               warnx ("Missing DATA marker in %s", filename);
-               return 1;
-            }
-         }
-         else if (strncmp (line, "DATA", 4) == 0)
-         {
-            // Old format without EXIT_X/ENTRY_X, this line is DATA marker
-            X = 0;  // Default entry position
-         }
-         else
-         {
-            fclose (f);
-            warnx ("Expected EXIT_X or DATA marker in %s", filename);
-            return 1;
-         }
-      }
-      else
-      {
-         fclose (f);
-         warnx ("Unexpected end of file in %s", filename);
-         return 1;
-      }
-      
-      // Validate dimensions if expected values provided
-      if (expected_W > 0 && W != expected_W)
-      {
-         fclose (f);
-         warnx ("Maze width mismatch: expected %d, got %d from %s", expected_W, W, filename);
-         return 1;
-      }
-      if (expected_H > 0 && H != expected_H)
-      {
-         fclose (f);
-         warnx ("Maze height mismatch: expected %d, got %d from %s", expected_H, H, filename);
-         return 1;
-      }
-      
-      // Read maze data (one row per line)
-      for (int y = 0; y < H; y++)
-      {
-         if (!fgets (line, sizeof (line), f))
-         {
-            fclose (f);
-            warnx ("Unexpected end of file reading maze data at row %d in %s", y, filename);
-            return 1;
-         }
-         
-         // Parse hex values from this row
-         char *ptr = line;
-         for (int x = 0; x < W; x++)
-         {
-            unsigned int val;
-            if (sscanf (ptr, "%2X", &val) != 1)
-            {
-               fclose (f);
-               warnx ("Invalid hex data at row %d, col %d in %s", y, x, filename);
-               return 1;
-            }
-            maze[x * H + y] = (unsigned char) val;
-            
-            // Move pointer past this hex value and any whitespace
-            ptr += 2;
-            while (*ptr == ' ' || *ptr == '\t')
-               ptr++;
-         }
-      }
-      
-      // Read END line
-      if (!fgets (line, sizeof (line), f) || strncmp (line, "END", 3) != 0)
-      {
-         fclose (f);
-         warnx ("Missing END marker in %s", filename);
-         return 1;
-      }
-      
-      fclose (f);
-      *actual_W = W;
-      *actual_H = H;
-      if (entry_x)
-         *entry_x = X;
-      if (helix_val)
-         *helix_val = helix;
-      return 0;
-   }
-
    /**
     * Appends formatted string to the maze data buffer for later inclusion in STL comments.
     * Dynamically grows the buffer as needed.
@@ -937,9 +2869,63 @@ main (int argc, const char *argv[])
          fprintf (out, ",font=\"%s\"", f);
       fprintf (out, ");\n");
    }
-   // The base
-   fprintf (out, "module outer(h,r){e=%lld;minkowski(){cylinder(r1=0,r2=e,h=e,$fn=24);cylinder(h=h-e,r=r,$fn=%d);}}\n",
-            scaled (outerround), outersides ? : 100);
+   // Native meshes
+   mesh_t *meshes = NULL;       // All meshes made
+   mesh_t *mesh = NULL;         // Mesh for polyhedron being output, if capturing
+   const char *nativeno = NULL; // Why native output is not possible
+   long dynamic[8];             // Start and end of the SCAD for mazes and nubs in the part being made, if nativestatic
+   int ndynamic = 0;
+   void dynamicmark (void)
+   {                            // Start or end of SCAD that is made natively rather than in the static part
+      if (nativestatic && ndynamic < (int) (sizeof (dynamic) / sizeof (*dynamic)))
+         dynamic[ndynamic++] = ftell (out);
+   }
+   long npoints = 0,            // Polyhedron points and faces output, for --timings
+      nfaces = 0;
+   unsigned long long nslices = 0,      // slice() calls and points passed looking for the ends, for --stats
+      nscan = 0;
+   int *facev = NULL,           // Face being output
+      facen = 0,
+      facemax = 0;
+   arena_t arena = { 0 };       // Working memory for each maze
+   char *json = NULL;           // Mazes for --maze-json
+   size_t jsonlen = 0;
+   int jsonmazes = 0;
+   FILE *jsonf = NULL;
+   if (mazejson && !(jsonf = open_memstream (&json, &jsonlen)))
+      err (1, "open_memstream");
+   if (nativestatic)
+   {                            // Static parts need the cache, and nothing that cuts into the maze from the static SCAD
+      const char *why = NULL;
+      if (!native || !stl)
+         why = "needs --native and --stl";
+      else if (!cachedir)
+         why = "needs --cache-dir";
+      else if (basewide)
+         why = "base wide";
+      else if (markpos0 && lastinside)
+         why = "position 0 mark on inside maze of last part";
+      if (why)
+      {
+         warnx ("Cannot make static parts (%s), not using --native-static", why);
+         nativestatic = 0;
+      }
+   }
+   if (native)
+   {                            // Only explicit polyhedra and solids of revolution can be made natively
+      if (!stl)
+         nativeno = "not making stl";
+      else if (nativestatic)
+         nativeno = NULL;       // Anything else is in the static parts
+      else if (!preview && (textend || textsides || textinside))
+         nativeno = "text";
+      else if (!preview && (aalogo || ajklogo))
+         nativeno = "logo";
+      else if (basewide)
+         nativeno = "base wide";
+      else if (markpos0 && lastinside)
+         nativeno = "mark";
+   }
    // Start
    double x = 0,
       y = 0;
@@ -966,6 +2952,7 @@ main (int argc, const char *argv[])
       int mazeoutside = !inside;        // This part has maze outside
       int nextinside = inside;  // Next part has maze inside
       int nextoutside = !inside;        // Next part has maze outside
+      pb_rng_seed (&rng, (unsigned long long) seed << 16 | part);  // Own stream per part so --part makes the same part as the whole box
       if (flip)
       {
          if (part & 1)
@@ -1008,6 +2995,196 @@ main (int argc, const char *argv[])
       double part_r2 = part_r2s[part];
       double part_r3 = part_r3s[part];
       int W = ((int) (part_r1 * 2 * M_PI / mazestep)) / nubs * nubs; // Default value
+      // Transform for this part, as the translate/rotate output below, for native meshes
+      double partxf[6] = { 1, 0, 0, 0, 1, 0 };
+      xf_translate (partxf, x + (outersides & 1 ? part_r3 : part_r2), y + (outersides & 1 ? part_r3 : part_r2));
+      if (outersides)
+         xf_rotate (partxf, (double) 180 / outersides + (part + 1 == parts ? 180 : 0));
+      double polyxf[6];         // Transform for current polyhedron
+      /**
+       * Starts capturing a polyhedron as a native mesh (if --native).
+       *
+       * @param xf Transform for the polyhedron (copied)
+       */
+      void polystart (const double *xf)
+      {
+         memcpy (polyxf, xf, sizeof (polyxf));
+         mesh = (native && !nativeno ? mesh_new (&meshes, part) : NULL);
+      }
+      void polyend (void)
+      {
+         if (mesh)
+            mesh_orient (mesh);
+         mesh = NULL;
+      }
+      /**
+       * Adds the copies of a nub or park ridge mesh round the part, one for each of the other nubs.
+       *
+       * @param m Mesh for the first nub
+       * @param xf Transform the mesh was made with
+       */
+      void copies (const mesh_t * m, const double *xf)
+      {
+         double inv[6];
+         memcpy (inv, xf, sizeof (inv));
+         xf_invert (inv);
+         for (int n = 1; n < nubs; n++)
+         {
+            double c[6];
+            memcpy (c, xf, sizeof (c));
+            xf_rotate (c, (double) 360 * n / nubs);
+            xf_mul (c, inv[0], inv[1], inv[2], inv[3], inv[4], inv[5]);
+            mesh_instance (&meshes, part, m, c);
+         }
+      }
+      void polylist (const char *s)
+      {                         // Start list of points or faces
+         fputs (s, out);
+      }
+      void polypoint (long long x, long long y, long long z)
+      {                         // Output a polyhedron point
+         npoints++;
+         out_3 (out, (long long[3]) { x, y, z });
+         if (mesh)
+         {
+            double X = (double) x / SCALE,
+               Y = (double) y / SCALE;
+            xf_apply (polyxf, &X, &Y);
+            mesh_point (mesh, X, Y, (double) z / SCALE);
+         }
+      }
+      void facestart (void)
+      {                         // Output a polyhedron face
+         nfaces++;
+         putc_unlocked ('[', out);
+         facen = 0;
+      }
+      void facepoint (int v)
+      {
+         if (facen)
+            putc_unlocked (',', out);
+         out_ll (out, v);
+         if (mesh)
+         {
+            if (facen >= facemax)
+            {
+               facemax = facemax * 2 + 64;
+               facev = realloc (facev, sizeof (*facev) * facemax);
+               if (!facev)
+                  errx (1, "malloc");
+            }
+            facev[facen] = v;
+         }
+         facen++;
+      }
+      void faceend (void)
+      {
+         fputs ("],", out);
+         if (mesh)
+            mesh_face (mesh, facen, facev, !xf_flipped (polyxf));
+      }
+      void facetri (int a, int b, int c)
+      {
+         facestart ();
+         facepoint (a);
+         facepoint (b);
+         facepoint (c);
+         faceend ();
+      }
+      /**
+       * Outputs the outer base, a prism of outersides (or 100) sides, with the bottom edge chamfered by outerround.
+       * This is the minkowski() of the prism with a cone of 24 sides, made as a polyhedron: the bottom is the prism's
+       * polygon, and from outerround up the polygon and the cone's polygon added (merging their edges in angle order).
+       *
+       * @param h Height
+       * @param r Radius of the prism's corners
+       */
+      void outer (double h, double r)
+      {
+         int n = (outersides ? : 100),
+            m = 24;
+         if (preview)
+         {
+            fprintf (out, "cylinder(h=%lld,r=%lld,$fn=%d);\n", scaled (h), scaled (r + outerround), outersides ? : 25);
+            return;
+         }
+         long long e = scaled (outerround),
+            R = scaled (r),
+            H = scaled (h);
+         // Angles in units of pi/n/m: corner i of the prism is at 2*m*i with normals within m, corner j of the cone at
+         // 2*n*j with normals within n, and the sum has corner i+j for each pair whose normals overlap
+         int first[n],          // First cone corner for each prism corner
+           count[n];            // Cone corners (the last is the first of the next prism corner, but for parallel sides)
+         for (int i = 0; i < n; i++)
+         {
+            count[i] = 0;
+            for (int k = 1 - m / 2; k <= m / 2; k++)
+            {                   // Cone corners from the lowest angle
+               int j = (m * i / n + k + m) % m,
+                  d = (2 * n * j - 2 * m * i) % (2 * n * m);
+               if (d > n * m)
+                  d -= 2 * n * m;
+               if (d <= -n * m)
+                  d += 2 * n * m;
+               if (d > -(n + m) && d < n + m)
+               {
+                  if (!count[i]++)
+                     first[i] = j;
+               }
+            }
+         }
+         int ring[n];           // Start of each prism corner's points in the ring
+         int np = 0;
+         for (int i = 0; i < n; i++)
+         {
+            ring[i] = np;
+            np += count[i];
+         }
+         polylist ("polyhedron(points=[");
+         for (int i = 0; i < n; i++)
+            polypoint (llround (R * cos (2 * M_PI * i / n)), llround (R * sin (2 * M_PI * i / n)), 0);
+         for (int z = 0; z < 2; z++)
+            for (int i = 0; i < n; i++)
+               for (int k = 0; k < count[i]; k++)
+               {
+                  int j = (first[i] + k) % m;
+                  polypoint (llround (R * cos (2 * M_PI * i / n) + e * cos (2 * M_PI * j / m)),
+                             llround (R * sin (2 * M_PI * i / n) + e * sin (2 * M_PI * j / m)), z ? H : e);
+               }
+         fprintf (out, "]");
+         polylist (",faces=[");
+         facestart ();          // Bottom
+         for (int i = 0; i < n; i++)
+            facepoint (i);
+         faceend ();
+         facestart ();          // Top
+         for (int k = np; k--;)
+            facepoint (n + np + k);
+         faceend ();
+         for (int i = 0; i < n; i++)
+         {                      // Chamfer
+            int i2 = (i + 1) % n;
+            for (int k = 0; k + 1 < count[i]; k++)
+               facetri (i, n + ring[i] + k, n + ring[i] + k + 1);
+            facestart ();
+            facepoint (i);
+            facepoint (n + ring[i] + count[i] - 1);
+            facepoint (n + ring[i2]);
+            facepoint (i2);
+            faceend ();
+         }
+         for (int k = 0; k < np; k++)
+         {                      // Sides
+            int k2 = (k + 1) % np;
+            facestart ();
+            facepoint (n + k);
+            facepoint (n + np + k);
+            facepoint (n + np + k2);
+            facepoint (n + k2);
+            faceend ();
+         }
+         fprintf (out, "]);\n");
+      }
       fprintf (out, "// Part %d (%.2fmm to %.2fmm and %.2fmm/%.2fmm base)\n", part, part_r0, part_r1, part_r2, part_r3);
       double height = (coresolid ? coregap + baseheight : 0) + coreheight + basethickness + (basethickness + basegap) * (part - 1);
       if (part == 1)
@@ -1015,6 +3192,20 @@ main (int argc, const char *argv[])
       if (part > 1)
          height -= baseheight;  // base from previous unit is added to this
       // Output
+      /**
+       * Angle of the position 0 mark, which is on the maze entry where the part has one.
+       *
+       * @return Angle in degrees
+       */
+      double markangle (void)
+      {
+         if (part == parts && mazeinside)
+            return (mirrorinside ? 1 : -1) * part_entrya;
+         if (part + 1 == parts && mazeoutside)
+            return part_entrya;
+         return 0;
+      }
+      int marked = 0;           // Position 0 mark cut natively in the maze
       /**
        * Generates a cylindrical maze pattern on the inside or outside of a part.
        * Creates a random maze using recursive backtracking algorithm, applies helix
@@ -1025,367 +3216,190 @@ main (int argc, const char *argv[])
        */
       void makemaze (double r, int inside)
       {                         // Make the maze
-         W = ((int) ((r + (inside ? mazethickness : -mazethickness)) * 2 * M_PI / mazestep)) / nubs * nubs;     // Update W for actual maze
          double base = (inside ? basethickness : baseheight);
          if ((inside && part > 1) || (!inside && part < parts))
             base += nubdistance; // Move maze up so nubs can reach bottom row
          base += (coresolid ? coreheight : 0);  // First one is short...
          if (inside)
             base += basegap;
-         double h = height - base - mazemargin - topspace - (parkvertical ? mazestep / 4 : 0) - mazestep / 8;
-         int H = (int) (h / mazestep);
          int abs_helix = helix < 0 ? -helix : helix;
-         fprintf (out, "// Maze %s %d/%d helix=%d (%s)\n", inside ? "inside" : "outside", W, H, helix,
+         pb_params_t mp = {
+            .helix = helix,.nubs = nubs,
+            .complexity = mazecomplexity,
+            .inside = inside,
+            .parkvertical = parkvertical,
+            .noa = noa,
+            .testmaze = testmaze,
+            .exitnub = (flip && !inside) || (flip_stagger && inside),
+            .step = mazestep,
+            .minsolution = minsolution,
+            .maxvertical = maxvertical,
+            .minchoices = minchoices,
+         };
+         int toosmall = pb_maze_size (&mp, r, mazethickness, base, height, mazemargin, topspace);
+         W = mp.W;               // Update W for actual maze
+         int H = mp.H;
+         fprintf (out, "// Maze %s %d/%d helix=%d (%s)\n", inside ? "inside" : "outside", W, H - 2 - abs_helix, helix,
                   helix > 0 ? "counter-clockwise" : helix < 0 ? "clockwise" : "none");
-         double y0 = base + mazestep / 2 - mazestep * (abs_helix + 1) + mazestep / 8;
-         H += 2 + abs_helix;    // Allow one above, one below and abs(helix) below
-         if (W < 3 || H < 1)
+         double y0 = mp.y0;
+         if (toosmall)
             errx (1, "Too small");
          double a = 0,
-            dy = 0;
+            dy = mp.dy;
          if (helix)
-         {
-            a = atan (mazestep * abs_helix / r / 2 / M_PI) * 180 / M_PI;
-            dy = mazestep * helix / W;  // signed: controls twist direction
-         }
-         unsigned char maze[W][H];
-         memset (maze, 0, sizeof (unsigned char) * W * H);
-         
-         // Check if we should load a pre-generated maze
-         const char *loadfile = inside ? loadmazeinside : loadmazeoutside;
-         const char *savefile = inside ? savemazeinside : savemazeoutside;
-         int maze_loaded = 0;
-         int maxx = 0;  // Entry point for maze (declare at function scope)
-         int maxy_exit = -1;  // Y row of exit (where DFS reached top) — may differ from maxY
-         double margin = mazemargin;  // Maze margin (declare at function scope)
-         
-         if (loadfile)
-         {
-            int loaded_W, loaded_H, loaded_helix = 0;
-            if (load_maze (loadfile, (unsigned char *) maze, W, H, &loaded_W, &loaded_H, &maxx, &loaded_helix) == 0)
-            {
-               // Successfully loaded maze
-               if (loaded_W != W || loaded_H != H)
-                  errx (1, "Loaded maze dimensions (%dx%d) don't match calculated dimensions (%dx%d) for %s maze",
-                        loaded_W, loaded_H, W, H, inside ? "inside" : "outside");
-               if (loaded_helix != helix)
-                  warnx ("Warning: Loaded maze helix (%d) doesn't match current helix (%d) - maze may not work correctly",
-                        loaded_helix, helix);
-               maze_loaded = 1;
-               fprintf (out, "// Loaded %s maze from %s (exit_x=%d, helix=%d)\n", inside ? "inside" : "outside", loadfile, maxx, loaded_helix);
-            }
-            else
-               errx (1, "Failed to load maze from %s", loadfile);
-         }
-         
-         /**
-          * Tests if a maze cell is already in use or out of bounds.
-          * Handles wrapping around the X axis (cylindrical topology) and
-          * checking the FLAGI (invalid) flag.
-          * 
-          * @param x X coordinate (wraps around cylinder)
-          * @param y Y coordinate (height)
-          * @return 1 if cell is in use or invalid, 0 if available
-          */
-         int test (int x, int y)
-         {                      // Test if in use...
-            while (x < 0)
-            {
-               x += W;
-               y -= helix;
-            }
-            while (x >= W)
-            {
-               x -= W;
-               y += helix;
-            }
-            int n = nubs;
-            unsigned char v = 0;
-            while (n--)
-            {
-               if (y < 0 || y >= H)
-                  v |= FLAGI;
-               else
-                  v |= maze[x][y];
-               if (!n)
-                  break;
-               x += W / nubs;
-               while (x >= W)
-               {
-                  x -= W;
-                  y += helix;
-               }
-               if (abs_helix == nubs)   // adjust for half-rotation height offset
-                  y -= (helix > 0 ? 1 : -1);  // +helix: band climbs right, correct down; -helix: band falls right, correct up
-            }
-            return v;
-         }
-         
-         // Generate maze (if not loaded from file)
-         if (!maze_loaded)
-         {                      // Maze
-            // Make maze
-            // Clear too high/low
-            for (Y = 0; Y < H; Y++)
-               for (X = 0; X < W; X++)
-                  if (mazestep * Y + y0 + dy * X < base + mazestep / 2 + mazestep / 8
-                      || mazestep * Y + y0 + dy * X > height - mazestep / 2 - margin - mazestep / 8)
-                     maze[X][Y] |= FLAGI;       // To high or low
-            // Final park point
-            if (parkvertical)
-            {
-               for (N = 0; N < abs_helix + 2; N++)  // Down to final
-               {
-                  maze[0][N] |= FLAGU + FLAGD;
-                  maze[X = 0][Y = N + 1] |= FLAGD;
-               }
-               if (!inside && !noa && W / nubs > 2 && H > abs_helix + 4)
-               {                // An "A" at finish
-                  maze[X][Y] |= FLAGD | FLAGU | FLAGR;
-                  maze[X][Y + 1] |= FLAGD | FLAGR;
-                  maze[X + 1][Y] |= FLAGD | FLAGU | FLAGL;
-                  maze[X + 1][Y + 1] |= FLAGD | FLAGL;
-                  maze[X + 1][Y - 1] |= FLAGU;
-                  X++;
-                  Y--;
-               }
-            } else              // Left to final
-            {
-               if (helix < 0)
-               {                // Negative helix: dy<0, so col seg-1 is physically lowest.
-                  //   col 0 row abs_helix+1 sits exactly at the FLAGI boundary (not caught by
-                  //   strict < check) — mark it FLAGI explicitly to remove that isolated cell.
-                  //   Park at col seg-1 row abs_helix+2 (lowest reachable). A extends left.
-                  int seg = W / nubs;
-                  maze[0][abs_helix + 1] |= FLAGI;               // eliminate isolated below-park cell
-                  maze[seg - 1][abs_helix + 2] |= FLAGL;         // park: connects left into F
-                  maze[X = seg - 2][Y = abs_helix + 2] |= FLAGR; // F(seg-2): right=park
-                  if (!inside && !noa && seg > 3 && H > abs_helix + 4)
-                  {                // An "A" at finish: horizontally mirrored vs. positive helix
-                     maze[X][Y] |= FLAGR | FLAGL | FLAGU;     // F(seg-2): right=park, left=E, up=B
-                     maze[X - 1][Y] |= FLAGR | FLAGU;         // E(seg-3): right=F, up=A  (dead end)
-                     maze[X - 1][Y + 1] |= FLAGR | FLAGD;     // A(seg-3): right=B, down=E  (dead end)
-                     maze[X][Y + 1] |= FLAGR | FLAGL | FLAGD; // B(seg-2): right=C, left=A, down=F
-                     maze[X + 1][Y + 1] |= FLAGL;             // C(seg-1): left=B — DFS continues up
-                     X++;
-                     Y++;
-                  }
-               } else
-               {
-                  maze[0][abs_helix + 1] |= FLAGR;
-                  maze[X = 1][Y = abs_helix + 1] |= FLAGL;
-                  if (!inside && !noa && W / nubs > 3 && H > abs_helix + 3)
-                  {                // An "A" at finish
-                     maze[X][Y] |= FLAGL | FLAGR | FLAGU;
-                     maze[X + 1][Y] |= FLAGL | FLAGU;
-                     maze[X + 1][Y + 1] |= FLAGL | FLAGD;
-                     maze[X][Y + 1] |= FLAGL | FLAGR | FLAGD;
-                     maze[X - 1][Y + 1] |= FLAGR;
-                     X--;
-                     Y++;
-                  }
-               }
-            }
-            // Make maze
-            maxx = 0;  // Reset maxx for generation
-            if (testmaze)
-            {                   // Simple test pattern
-               for (Y = 0; Y < H; Y++)
-                  for (X = 0; X < W; X++)
-                     if (!(test (X, Y) & FLAGI) && !(test (X + 1, Y) & FLAGI))
-                     {
-                        maze[X][Y] |= FLAGR;
-                        int x = X + 1,
-                           y = Y;
-                        if (x >= W)
-                        {
-                           x -= W;
-                           y += helix;
-                        }
-                        maze[x][y] |= FLAGL;
-                     }
-               if ((!flip || inside) && (!flip_stagger || !inside))
-                  while (maxx + 1 < W && !(test (maxx + 1, H - 2) & FLAGI))
-                     maxx++;
-            } else
-            {                   // Actual maze
-               int max = 0;
-               typedef struct pos_s pos_t;
-               struct pos_s
-               {
-                  pos_t *next;
-                  int x,
-                    y,
-                    n;
-               };
-               pos_t *pos = malloc (sizeof (*pos)),
-                  *last = NULL;
-               pos->x = X;
-               pos->y = Y;
-               pos->n = 0;
-               pos->next = NULL;
-               last = pos;
-               while (pos)
-               {
-                  pos_t *p = pos;
-                  pos = p->next;
-                  p->next = NULL;
-                  if (!pos)
-                     last = NULL;
-                  // Where we are
-                  X = p->x;
-                  Y = p->y;
-                  int v,
-                    n = 0;
-                  // Which way can we go
-                  // Some bias for direction
-                  if (!test (X + 1, Y))
-                     n += BIASR;        // Right
-                  if (!test (X - 1, Y))
-                     n += BIASL;        // Left
-                  if (!test (X, Y - 1))
-                     n += BIASD;        // Down
-                  if (!test (X, Y + 1))
-                     n += BIASU;        // Up
-                  if (!n)
-                  {             // No way forward
-                     free (p);
-                     continue;
-                  }
-                  // Pick one of the ways randomly
-                  if (read (f, &v, sizeof (v)) != sizeof (v))
-                     err (1, "Read /dev/random");
-                  v %= n;
-                  // Move forward
-                  if (!test (X + 1, Y) && (v -= BIASR) < 0)
-                  {             // Right
-                     maze[X][Y] |= FLAGR;
-                     X++;
-                     if (X >= W)
-                     {
-                        X -= W;
-                        Y += helix;
-                     }
-                     maze[X][Y] |= FLAGL;
-                  } else if (!test (X - 1, Y) && (v -= BIASL) < 0)
-                  {             // Left
-                     maze[X][Y] |= FLAGL;
-                     X--;
-                     if (X < 0)
-                     {
-                        X += W;
-                        Y -= helix;
-                     }
-                     maze[X][Y] |= FLAGR;
-                  } else if (!test (X, Y - 1) && (v -= BIASD) < 0)
-                  {             // Down
-                     maze[X][Y] |= FLAGD;
-                     Y--;
-                     maze[X][Y] |= FLAGU;
-                  } else if (!test (X, Y + 1) && (v -= BIASU) < 0)
-                  {             // Up
-                     maze[X][Y] |= FLAGU;
-                     Y++;
-                     maze[X][Y] |= FLAGD;
-                  } else
-                     errx (1, "WTF");   // We should have picked a way we can go
-                  // Entry
-                  if (p->n > max && (test (X, Y + 1) & FLAGI)   //
-                      && (!flip || inside || !(X % (W / nubs)))        //
-                      && (!flip_stagger || !inside || !(X % (W / nubs))))
-                  {             // Longest path that reaches top
-                     max = p->n;
-                     maxx = X;
-                     maxy_exit = Y;  // Record exit Y (cell below FLAGI boundary)
-                  }
-                  // Next point to consider
-                  pos_t *next = malloc (sizeof (*next));
-                  next->x = X;
-                  next->y = Y;
-                  next->n = p->n + 1;
-                  next->next = NULL;
-                  // How to add points to queue... start or end
-                  if (read (f, &v, sizeof (v)) != sizeof (v))
-                     err (1, "Read /dev/random");
-                  v %= 10;
-                  if (v < (mazecomplexity < 0 ? -mazecomplexity : mazecomplexity))
-                  {             // add next point at start - makes for longer path
-                     if (!pos)
-                        last = next;
-                     next->next = pos;
-                     pos = next;
-                  } else
-                  {             // add next point at end - makes for multiple paths, which can mean very simple solution
-                     if (last)
-                        last->next = next;
-                     else
-                        pos = next;
-                     last = next;
-                  }
-                  if (mazecomplexity <= 0 && v < -mazecomplexity)
-                  {             // current point to start
-                     if (!pos)
-                        last = p;
-                     p->next = pos;
-                     pos = p;
-                  } else
-                  {
-                     if (last)
-                        last->next = p;
-                     else
-                        pos = p;
-                     last = p;
-                  }
-               }
-               fprintf (out, "// Path length %d\n", max);
-            }
-            part_entrya = (double) 360 *maxx / W;
-            part_mazeexit = part_entrya;  // Save maze exit angle for opposite nub positioning
-            if (fixnubs && globalexit == 0)
-               globalexit = part_entrya;  // Save first maze exit globally for consistent nub positioning
-            // Entry point for maze
-            for (X = maxx % (W / nubs); X < W; X += W / nubs)
-            {
-               Y = H - 1;
-               while (Y && (maze[X][Y] & FLAGI))
-                  maze[X][Y--] |= FLAGU + FLAGD;
-               maze[X][Y] += FLAGU;
+            a = atan (mazestep * abs_helix / r / 2 / M_PI) * 180 / M_PI;
+         arena_reset (&arena);
+         unsigned char (*maze)[H] = arena_take (&arena, W * H);
+         pb_maze_t m = {.W = W,.H = H,.helix = helix,.nubs = nubs,.maze = (unsigned char *) maze };
+         
+         // Check if we should load a pre-generated maze
+         const char *loadfile = inside ? loadmazeinside : loadmazeoutside;
+         const char *savefile = inside ? savemazeinside : savemazeoutside;
+         int maxx = 0;  // Entry point for maze (declare at function scope)
+         int maxy_exit = -1;  // Y row of exit (where DFS reached top) — may differ from maxY
+         double margin = mazemargin;  // Maze margin (declare at function scope)
+         
+         stage (STAGE_MAZE);
+         if (loadfile)
+         {
+            if (pb_maze_load (loadfile, &m, W, H))
+               errx (1, "Failed to load maze from %s", loadfile);
+            if (m.helix != helix)
+               warnx ("Warning: Loaded maze helix (%d) doesn't match current helix (%d) - maze may not work correctly",
+                     m.helix, helix);
+            fprintf (out, "// Loaded %s maze from %s (exit_x=%d, helix=%d)\n", inside ? "inside" : "outside", loadfile, m.exit_x, m.helix);
+            m.helix = helix;
+         } else
+         {                      // Generate maze
+            int n = (testmaze || candidates < 1 ? 1 : candidates),
+               k = (keep < 1 ? 1 : keep > n ? n : keep),
+               targets = (!testmaze && (minsolution || maxvertical || minchoices));
+            pb_maze_t *top = arena_take (&arena, sizeof (*top) * k);     // Best candidates, best first
+            pb_score_t *tops = arena_take (&arena, sizeof (*tops) * k);
+            int kept = 0;
+            unsigned char *cells = NULL;
+            pb_stats_t before;
+            pb_stats_get (&before);
+            if (n == 1 && !targets)
+            {                   // Just the one
+               if (pb_maze_generate (&m, &mp, &rng))
+                  errx (1, "Failed to make %s maze", inside ? "inside" : "outside");
+            } else
+            {                   // Make candidates, keeping the best k
+               cells = arena_take (&arena, k * W * H);
+               for (int i = 0; i < k; i++)
+                  top[i].maze = cells + i * W * H;
+               kept = pb_maze_search (&mp, (unsigned long long) seed << 16 | part, n, threads, k, top, tops);
+               if (kept <= 0)
+                  errx (1, "Failed to make %s maze", inside ? "inside" : "outside");
+               memcpy (maze, top[0].maze, W * H);
+               m = top[0];
+               m.maze = (unsigned char *) maze;
+               pb_stats_t after;
+               pb_stats_get (&after);
+               n = after.mazes - before.mazes;  // More if looking for the targets
+               if (targets && !pb_maze_targets (&mp, &tops[0]))
+                  warnx ("No %s maze for part %d met the targets in %d tries, using the best (solution %d, vertical %d, choices %d)",
+                         inside ? "inside" : "outside", part, n, tops[0].solution, tops[0].vertical, tops[0].choices);
             }
-            
+            if (!testmaze)
+               fprintf (out, "// Path length %d\n", m.path);
+            if (n > 1 || targets)
+               fprintf (out, "// Best of %d candidates: score %.1f (solution %d, choices %d, traps %d, trap cells %d, small traps %d, down traps %d, vertical %d)\n",
+                        n, tops[0].score, tops[0].solution, tops[0].choices, tops[0].traps, tops[0].trapcells, tops[0].smalltraps,
+                        tops[0].downtraps, tops[0].vertical);
             // Save generated maze if requested
             if (savefile)
             {
-               save_maze (savefile, (unsigned char *) maze, W, H, maxx, helix);
-               fprintf (out, "// Saved %s maze to %s (exit_x=%d, helix=%d)\n", inside ? "inside" : "outside", savefile, maxx, helix);
+               if (pb_maze_save (savefile, &m, n > 1 || targets ? &tops[0] : NULL))
+                  errx (1, "Failed to save maze to %s", savefile);
+               fprintf (out, "// Saved %s maze to %s (exit_x=%d, helix=%d)\n", inside ? "inside" : "outside", savefile, m.exit_x, helix);
+               for (int i = 1; i < kept; i++)
+               {                // Runners up
+                  char *fn;
+                  int l = strlen (savefile);
+                  if (l > 5 && !strcasecmp (savefile + l - 5, ".pbmz"))
+                     l -= 5;    // Keep binary
+                  if (asprintf (&fn, "%.*s.%d%s", l, savefile, i + 1, savefile + l) < 0)
+                     errx (1, "malloc");
+                  if (pb_maze_save (fn, &top[i], &tops[i]))
+                     errx (1, "Failed to save maze to %s", fn);
+                  fprintf (out, "// Saved %s maze to %s (exit_x=%d, helix=%d, score %.1f)\n", inside ? "inside" : "outside", fn, top[i].exit_x,
+                           helix, tops[i].score);
+                  free (fn);
+               }
+            }
+         }
+         maxx = m.exit_x;
+         maxy_exit = m.exit_y;
+         part_entrya = (double) 360 *maxx / W;
+         part_mazeexit = part_entrya;  // Save maze exit angle for opposite nub positioning
+         if (fixnubs && globalexit == 0)
+            globalexit = part_entrya;  // Save first maze exit globally for consistent nub positioning
+         if (jsonf)
+         {                      // Straight from the maze, for --maze-json
+            int *path = arena_take (&arena, sizeof (*path) * W * H),
+               len = pb_maze_solve (&m, path);
+            fprintf (jsonf, "%s{\"part\":%d,\"side\":\"%s\",\"W\":%d,\"H\":%d,\"helix\":%d,\"nubs\":%d,", jsonmazes++ ? "," : "",
+                     part, inside ? "inside" : "outside", W, H, helix, nubs);
+            fprintf (jsonf, "\"entrance\":[%d,%d],\"exit\":[%d,%d],\"path\":%d,\"grid\":[", helix < 0 ? W / nubs - 1 : 0,
+                     abs_helix + (helix < 0 ? 2 : 1), m.exit_x, m.exit_y, m.path);
+            for (int Y = 0; Y < H; Y++)
+            {
+               fprintf (jsonf, "%s\"", Y ? "," : "");
+               for (int X = 0; X < W; X++)
+                  fprintf (jsonf, "%02X", maze[X][Y]);
+               fputc ('"', jsonf);
             }
-         }  // End of maze generation block
-         else
+            fprintf (jsonf, "],\"solution\":[");
+            for (int i = 0; i < len; i++)
+               fprintf (jsonf, "%s[%d,%d]", i ? "," : "", path[i] / H, path[i] % H);
+            fprintf (jsonf, "]}");
+         }
+
+         /**
+          * Tests if a maze cell is already in use or out of bounds.
+          * 
+          * @param x X coordinate (wraps around cylinder)
+          * @param y Y coordinate (height)
+          * @return 1 if cell is in use or invalid, 0 if available
+          */
+         int test (int x, int y)
+         {                      // Test if in use...
+            return pb_maze_test (&m, x, y);
+         }
+
+         // Output maze visualization, the solution and maze data - as SCAD comments (--annotations) and for .meta
+         int vizout = (annotate == ANNOTATE_FULL),
+            vizdata = (stl && outfile);        // For .meta
+         void viz (const char *fmt, ...)
+         {                      // SCAD comment, if wanted
+            if (!vizout)
+               return;
+            va_list ap;
+            va_start (ap, fmt);
+            vfprintf (out, fmt, ap);
+            va_end (ap);
+         }
+         if (vizout || vizdata || annotate == ANNOTATE_COMPACT)
          {
-            // Maze was loaded from file with entry point position
-            // Calculate the angles based on the loaded entry position
-            part_entrya = (double) 360 * maxx / W;
-            part_mazeexit = part_entrya;
-            if (fixnubs && globalexit == 0)
-               globalexit = part_entrya;
-         }
-
-         // Output maze visualization
-            fprintf (out, "//\n");
-            fprintf (out, "// ============ MAZE VISUALIZATION (%s, %dx%d, helix=%d) ============\n", inside ? "INSIDE" : "OUTSIDE", W, H, helix);
-            fprintf (out, "//\n");
-            fprintf (out, "// Human-readable maze (viewed from outside, unwrapped):\n");
-            fprintf (out, "// Legend: + = corner, - = horizontal wall, | = vertical wall, # = invalid, E = exit, space = passage\n");
+            stage (STAGE_VIZ);
+            viz ("//\n");
+            viz ("// ============ MAZE VISUALIZATION (%s, %dx%d, helix=%d) ============\n", inside ? "INSIDE" : "OUTSIDE", W, H, helix);
+            viz ("//\n");
+            viz ("// Human-readable maze (viewed from outside, unwrapped):\n");
+            viz ("// Legend: + = corner, - = horizontal wall, | = vertical wall, # = invalid, E = exit, space = passage\n");
             if (helix > 0)
-               fprintf (out, "// Note: Maze wraps helically - crossing the seam shifts up %d row(s) (counter-clockwise)\n", abs_helix);
+               viz ("// Note: Maze wraps helically - crossing the seam shifts up %d row(s) (counter-clockwise)\n", abs_helix);
             else if (helix < 0)
-               fprintf (out, "// Note: Maze wraps helically - crossing the seam shifts down %d row(s) (clockwise)\n", abs_helix);
+               viz ("// Note: Maze wraps helically - crossing the seam shifts down %d row(s) (clockwise)\n", abs_helix);
             else
-               fprintf (out, "// Note: Maze wraps horizontally (cylinder) - leftmost and rightmost edges connect\n");
-            fprintf (out, "// Note: With %d nubs, the maze pattern repeats every %d cells around the circumference\n", nubs, W / nubs);
-            fprintf (out, "//\n");
+               viz ("// Note: Maze wraps horizontally (cylinder) - leftmost and rightmost edges connect\n");
+            viz ("// Note: With %d nubs, the maze pattern repeats every %d cells around the circumference\n", nubs, W / nubs);
+            viz ("//\n");
             
             // Store in buffer for STL
-            if (stl)
+            if (vizdata)
             {
                appendmazedata ("\n");
                appendmazedata ("============ MAZE VISUALIZATION (%s, %dx%d, helix=%d) ============\n", inside ? "INSIDE" : "OUTSIDE", W, H, helix);
@@ -1440,22 +3454,23 @@ main (int argc, const char *argv[])
                }
             }
             
-            fprintf (out, "// Showing rows %d to %d (valid maze area, helix=%d)\n", minY, maxY, helix);
-            if (stl)
+            viz ("// Showing rows %d to %d (valid maze area, helix=%d)\n", minY, maxY, helix);
+            if (vizdata)
                appendmazedata ("Showing rows %d to %d (valid maze area, helix=%d)\n", minY, maxY, helix);
             
             // Create a copy of maze data for visualization
-            unsigned char maze_viz[W][H];
+            stage (STAGE_SOLVE);
+            unsigned char (*maze_viz)[H] = arena_take (&arena, W * H);
 	    memcpy(maze_viz, maze, sizeof(unsigned char)*W*H);
             
             // Replicate maze data by traversing from start and copying each cell to opposite side
             if (nubs > 1)
             {
                // Use a simple queue for BFS traversal
-               int queueX[W * H], queueY[W * H];
+               int *queueX = arena_take (&arena, sizeof (int) * W * H),
+                  *queueY = arena_take (&arena, sizeof (int) * W * H);
                int qhead = 0, qtail = 0;
-               char visited[W][H];
-               memset(visited, 0, sizeof(visited));
+               char (*visited)[H] = arena_take (&arena, W * H);
                
                // Start at the entry point (use maxy_exit if available)
                int viz_start_y = (maxy_exit >= 0) ? maxy_exit : maxY;
@@ -1554,10 +3569,8 @@ main (int argc, const char *argv[])
             }
             
             // Find solution path from entrance to exit
-            char solution[W][H];  // Stores direction: 0=none, 'U'=up, 'D'=down, 'L'=left, 'R'=right, 'S'=start
-            char reachable[W][H]; // Stores which cells are reachable from entrance
-            memset(solution, 0, sizeof(solution));
-            memset(reachable, 0, sizeof(reachable));
+            char (*solution)[H] = arena_take (&arena, W * H);  // Stores direction: 0=none, 'U'=up, 'D'=down, 'L'=left, 'R'=right, 'S'=start
+            char (*reachable)[H] = arena_take (&arena, W * H); // Stores which cells are reachable from entrance
             
             // Park: col 0 row abs_helix+1 for positive/zero helix (col 0 is physically lowest).
             // Park: col W/nubs-1 row abs_helix+2 for negative helix (col W/nubs-1 is lowest;
@@ -1565,133 +3578,25 @@ main (int argc, const char *argv[])
             int entrance_x = (helix < 0 ? W / nubs - 1 : 0);
             int entrance_y = abs_helix + (helix < 0 ? 2 : 1);
 	    int _exit_x = -1;
+            int full = (vizout || vizdata);     // Solution and visualisation wanted
             
-            if (entrance_y >= minY && entrance_y <= maxY)
+            if (full && entrance_y >= minY && entrance_y <= maxY)
             {
-               // BFS to find path from entrance to exit
+               // The solution, from the maze library, to the exit as the visualisation has it
                // Use maxy_exit if available (actual DFS exit row), otherwise fall back to maxY
-               int target_y = (maxy_exit >= 0) ? maxy_exit : maxY;
-               int queueX[W * H], queueY[W * H];
-               int parentX[W][H], parentY[W][H];
-               int qhead = 0, qtail = 0;
-               char visited[W][H];
-               memset(visited, 0, sizeof(visited));
-               memset(parentX, -1, sizeof(parentX));
-               memset(parentY, -1, sizeof(parentY));
-               
-               queueX[qtail] = entrance_x;
-               queueY[qtail] = entrance_y;
-               qtail++;
-               visited[entrance_x][entrance_y] = 1;
-               parentX[entrance_x][entrance_y] = entrance_x;
-               parentY[entrance_x][entrance_y] = entrance_y;
-               
-               int found = 0;
-               while (qhead < qtail && !found)
-               {
-                  int cx = queueX[qhead];
-                  int cy = queueY[qhead];
-                  qhead++;
-                  
-                  if (cx == maxx && cy == target_y)
-                  {
-                     found = 1;
-                     break;
-                  }
-                  
-                  // Try all four directions
-                  if (maze[cx][cy] & FLAGR)
-                  {
-                     int nx = cx + 1;
-                     int ny = cy;
-                     if (nx >= W)
-                     {
-                        nx -= W;
-                        ny += helix;
-                     }
-                     if (ny >= 0 && ny < H && !visited[nx][ny] && !(maze[nx][ny] & FLAGI))
-                     {
-                        visited[nx][ny] = 1;
-                        parentX[nx][ny] = cx;
-                        parentY[nx][ny] = cy;
-                        queueX[qtail] = nx;
-                        queueY[qtail] = ny;
-                        qtail++;
-                     }
-                  }
-                  if (maze[cx][cy] & FLAGL)
-                  {
-                     int nx = cx - 1;
-                     int ny = cy;
-                     if (nx < 0)
-                     {
-                        nx += W;
-                        ny -= helix;
-                     }
-                     if (ny >= 0 && ny < H && !visited[nx][ny] && !(maze[nx][ny] & FLAGI))
-                     {
-                        visited[nx][ny] = 1;
-                        parentX[nx][ny] = cx;
-                        parentY[nx][ny] = cy;
-                        queueX[qtail] = nx;
-                        queueY[qtail] = ny;
-                        qtail++;
-                     }
-                  }
-                  if (maze[cx][cy] & FLAGU)
-                  {
-                     int nx = cx;
-                     int ny = (cy + 1) % H;
-                     if (!visited[nx][ny] && !(maze[nx][ny] & FLAGI))
-                     {
-                        visited[nx][ny] = 1;
-                        parentX[nx][ny] = cx;
-                        parentY[nx][ny] = cy;
-                        queueX[qtail] = nx;
-                        queueY[qtail] = ny;
-                        qtail++;
-                     }
-                  }
-                  if (maze[cx][cy] & FLAGD)
-                  {
-                     int nx = cx;
-                     int ny = (cy - 1 + H) % H;
-                     if (!visited[nx][ny] && !(maze[nx][ny] & FLAGI))
-                     {
-                        visited[nx][ny] = 1;
-                        parentX[nx][ny] = cx;
-                        parentY[nx][ny] = cy;
-                        queueX[qtail] = nx;
-                        queueY[qtail] = ny;
-                        qtail++;
-                     }
-                  }
-               }
-               
-               // Trace back from exit to entrance to mark solution path
-               if (found)
+               pb_maze_t sm = m;
+               sm.exit_y = (maxy_exit >= 0) ? maxy_exit : maxY;
+               int *path = arena_take (&arena, sizeof (int) * W * H),
+                  path_len = pb_maze_solve (&sm, path);
+               if (path_len > 0)
                {
-                  // Build path from entrance to exit by following parents backward
-                  int path_x[W * H], path_y[W * H];
-                  int path_len = 0;
-                  
-                  int cx = maxx;
-                  int cy = target_y;
-                  
-                  // Trace back to build path array
-                  while (1)
+                  // The path from the exit back to the entrance
+                  int *path_x = arena_take (&arena, sizeof (int) * W * H),
+                     *path_y = arena_take (&arena, sizeof (int) * W * H);
+                  for (int i = 0; i < path_len; i++)
                   {
-                     path_x[path_len] = cx;
-                     path_y[path_len] = cy;
-                     path_len++;
-                     
-                     if (cx == entrance_x && cy == entrance_y)
-                        break;
-                     
-                     int px = parentX[cx][cy];
-                     int py = parentY[cx][cy];
-                     cx = px;
-                     cy = py;
+                     path_x[i] = path[path_len - 1 - i] / H;
+                     path_y[i] = path[path_len - 1 - i] % H;
                   }
                   
                   // Now mark cells with arrows pointing toward exit
@@ -1764,504 +3669,495 @@ main (int argc, const char *argv[])
                }
                
                // Now mark all cells reachable from entrance (for dead end detection)
-               // Reuse the BFS queue
-               qhead = 0;
-               qtail = 0;
-               
-               queueX[qtail] = entrance_x;
-               queueY[qtail] = entrance_y;
-               qtail++;
-               reachable[entrance_x][entrance_y] = 1;
-               
-               while (qhead < qtail)
-               {
-                  int cx = queueX[qhead];
-                  int cy = queueY[qhead];
-                  qhead++;
-                  
-                  // Try all four directions
-                  if (maze[cx][cy] & FLAGR)
-                  {
-                     int nx = cx + 1;
-                     int ny = cy;
-                     if (nx >= W)
-                     {
-                        nx -= W;
-                        ny += helix;
-                     }
-                     if (ny >= 0 && ny < H && !reachable[nx][ny] && !(maze[nx][ny] & FLAGI))
-                     {
-                        reachable[nx][ny] = 1;
-                        queueX[qtail] = nx;
-                        queueY[qtail] = ny;
-                        qtail++;
-                     }
-                  }
-                  if (maze[cx][cy] & FLAGL)
-                  {
-                     int nx = cx - 1;
-                     int ny = cy;
-                     if (nx < 0)
-                     {
-                        nx += W;
-                        ny -= helix;
-                     }
-                     if (ny >= 0 && ny < H && !reachable[nx][ny] && !(maze[nx][ny] & FLAGI))
-                     {
-                        reachable[nx][ny] = 1;
-                        queueX[qtail] = nx;
-                        queueY[qtail] = ny;
-                        qtail++;
-                     }
-                  }
-                  if (maze[cx][cy] & FLAGU)
-                  {
-                     int nx = cx;
-                     int ny = cy + 1;
-                     if (ny >= 0 && ny < H && !reachable[nx][ny] && !(maze[nx][ny] & FLAGI))
-                     {
-                        reachable[nx][ny] = 1;
-                        queueX[qtail] = nx;
-                        queueY[qtail] = ny;
-                        qtail++;
-                     }
-                  }
-                  if (maze[cx][cy] & FLAGD)
-                  {
-                     int nx = cx;
-                     int ny = cy - 1;
-                     if (ny >= 0 && ny < H && !reachable[nx][ny] && !(maze[nx][ny] & FLAGI))
-                     {
-                        reachable[nx][ny] = 1;
-                        queueX[qtail] = nx;
-                        queueY[qtail] = ny;
-                        qtail++;
-                     }
-                  }
-               }
+               pb_maze_reach (&m, (unsigned char *) reachable);
             }
             
-            for (Y = maxY + 1; Y >= minY; Y--)
+            if (full)
             {
-               // Draw horizontal walls and corners
-               fprintf (out, "// ");
-               if (stl)
-                  appendmazedata (" ");
-               for (X = 0; X < W; X++)
+               stage (STAGE_VIZ);
+               for (Y = maxY + 1; Y >= minY; Y--)
                {
-                  fprintf (out, "+");
-                  if (stl)
-                     appendmazedata ("+");
-                  // Draw horizontal edge between cells
-                  if (Y == maxY + 1)
+                  // Draw horizontal walls and corners
+                  viz ("// ");
+                  if (vizdata)
+                     appendmazedata (" ");
+                  for (X = 0; X < W; X++)
                   {
-                     // Top border - check if this is an exit (exits occur at multiples of W/nubs)
-                     int is_exit = 0;
-                     for (int n = 0; n < nubs; n++)
+                     viz ("+");
+                     if (vizdata)
+                        appendmazedata ("+");
+                     // Draw horizontal edge between cells
+                     if (Y == maxY + 1)
                      {
-                        int exit_x = (maxx + n * (W / nubs)) % W;
-                        if (X == exit_x)
+                        // Top border - check if this is an exit (exits occur at multiples of W/nubs)
+                        int is_exit = 0;
+                        for (int n = 0; n < nubs; n++)
                         {
-                           is_exit = 1;
-                           break;
+                           int exit_x = (maxx + n * (W / nubs)) % W;
+                           if (X == exit_x)
+                           {
+                              is_exit = 1;
+                              break;
+                           }
                         }
-                     }
-                     if (is_exit)
-                        fprintf (out, " E ");
-                     else
-                        fprintf (out, "---");
-                     if (stl)
-                     {
                         if (is_exit)
-                           appendmazedata (" E ");
+                           viz (" E ");
                         else
+                           viz ("---");
+                        if (vizdata)
+                        {
+                           if (is_exit)
+                              appendmazedata (" E ");
+                           else
+                              appendmazedata ("---");
+                        }
+                     }
+                     else if (Y == minY)
+                     {
+                        // Bottom border
+                        viz ("---");
+                        if (vizdata)
                            appendmazedata ("---");
                      }
-                  }
-                  else if (Y == minY)
-                  {
-                     // Bottom border
-                     fprintf (out, "---");
-                     if (stl)
-                        appendmazedata ("---");
-                  }
-                  else
-                  {
-                     // Interior - check if there's a passage up from cell below
-                     if ((maze_viz[X][Y - 1] & FLAGU))
-                        fprintf (out, "   ");  // Passage (no wall)
                      else
-                        fprintf (out, "---");  // Wall
-                     if (stl)
                      {
+                        // Interior - check if there's a passage up from cell below
                         if ((maze_viz[X][Y - 1] & FLAGU))
-                           appendmazedata ("   ");
+                           viz ("   ");  // Passage (no wall)
                         else
-                           appendmazedata ("---");
+                           viz ("---");  // Wall
+                        if (vizdata)
+                        {
+                           if ((maze_viz[X][Y - 1] & FLAGU))
+                              appendmazedata ("   ");
+                           else
+                              appendmazedata ("---");
+                        }
                      }
                   }
-               }
-               fprintf (out, "+\n");
-               if (stl)
-                  appendmazedata ("+\n");
+                  viz ("+\n");
+                  if (vizdata)
+                     appendmazedata ("+\n");
                
-               // Draw vertical walls and cell interiors
-               if (Y > minY)
-               {
-                  fprintf (out, "// ");
-                  if (stl)
-                     appendmazedata (" ");
-                  
-                  for (X = 0; X < W; X++)
+                  // Draw vertical walls and cell interiors
+                  if (Y > minY)
                   {
-                     // Left edge - check for wrap-around from previous cell
-                     if (X == 0)
+                     viz ("// ");
+                     if (vizdata)
+                        appendmazedata (" ");
+                  
+                     for (X = 0; X < W; X++)
                      {
-                        // Check if last cell (W-1) has FLAGR (connects to cell 0)
-                        if (maze_viz[W - 1][Y - 1] & FLAGR)
+                        // Left edge - check for wrap-around from previous cell
+                        if (X == 0)
+                        {
+                           // Check if last cell (W-1) has FLAGR (connects to cell 0)
+                           if (maze_viz[W - 1][Y - 1] & FLAGR)
+                           {
+                              viz (" ");  // Passage wrapping from last to first
+                              if (vizdata)
+                                 appendmazedata (" ");
+                           }
+                           else
+                           {
+                              viz ("|");  // Wall at left boundary
+                              if (vizdata)
+                                 appendmazedata ("|");
+                           }
+                        }
+                     
+                        // Cell interior
+                        if (maze_viz[X][Y - 1] & FLAGI)
+                        {
+                           viz ("###");
+                           if (vizdata)
+                              appendmazedata ("###");
+                        }
+                        else
+                        {
+                           viz ("   ");
+                           if (vizdata)
+                              appendmazedata ("   ");
+                        }
+                     
+                        // Right edge - check if there's a passage to the right
+                        if (maze_viz[X][Y - 1] & FLAGR)
                         {
-                           fprintf (out, " ");  // Passage wrapping from last to first
-                           if (stl)
+                           viz (" ");  // Passage to right
+                           if (vizdata)
                               appendmazedata (" ");
                         }
                         else
                         {
-                           fprintf (out, "|");  // Wall at left boundary
-                           if (stl)
+                           viz ("|");  // Wall to right
+                           if (vizdata)
                               appendmazedata ("|");
                         }
                      }
-                     
-                     // Cell interior
-                     if (maze_viz[X][Y - 1] & FLAGI)
-                     {
-                        fprintf (out, "###");
-                        if (stl)
-                           appendmazedata ("###");
-                     }
-                     else
-                     {
-                        fprintf (out, "   ");
-                        if (stl)
-                           appendmazedata ("   ");
-                     }
-                     
-                     // Right edge - check if there's a passage to the right
-                     if (maze_viz[X][Y - 1] & FLAGR)
-                     {
-                        fprintf (out, " ");  // Passage to right
-                        if (stl)
-                           appendmazedata (" ");
-                     }
-                     else
-                     {
-                        fprintf (out, "|");  // Wall to right
-                        if (stl)
-                           appendmazedata ("|");
-                     }
+                     viz ("\n");
+                     if (vizdata)
+                        appendmazedata ("\n");
                   }
-                  fprintf (out, "\n");
-                  if (stl)
-                     appendmazedata ("\n");
                }
-            }
-            fprintf (out, "//\n");
-            if (stl)
-               appendmazedata ("\n");
-            
-            // Second visualization with solution
-            fprintf (out, "//\n");
-            fprintf (out, "// ============ MAZE WITH SOLUTION ============\n");
-            fprintf (out, "//\n");
-            fprintf (out, "// Legend: S = start, arrows (↑↓←→) show path to exit\n");
-            fprintf (out, "//\n");
-            if (stl)
-            {
-               appendmazedata ("\n");
-               appendmazedata ("============ MAZE WITH SOLUTION ============\n");
-               appendmazedata ("\n");
-               appendmazedata ("Legend: S = start, arrows (↑↓←→) show path to exit\n");
-               appendmazedata ("\n");
-            }
+               viz ("//\n");
+               if (vizdata)
+                  appendmazedata ("\n");
             
-            for (Y = maxY + 1; Y >= minY; Y--)
-            {
-               // Draw horizontal walls and corners
-               fprintf (out, "// ");
-               if (stl)
-                  appendmazedata (" ");
-               for (X = 0; X < W; X++)
+               // Second visualization with solution
+               viz ("//\n");
+               viz ("// ============ MAZE WITH SOLUTION ============\n");
+               viz ("//\n");
+               viz ("// Legend: S = start, arrows (↑↓←→) show path to exit\n");
+               viz ("//\n");
+               if (vizdata)
                {
-                  fprintf (out, "+");
-                  if (stl)
-                     appendmazedata ("+");
-                  // Draw horizontal edge between cells
-                  if (Y == maxY + 1)
-                  {
-                     // Top border - check if this is an exit (exits occur at multiples of W/nubs)
-                     int is_exit = 0;
-                     for (int n = 0; n < nubs; n++)
-                     {
-                        int exit_x = (maxx + n * (W / nubs)) % W;
-                        if (X == exit_x)
-                        {
-                           is_exit = 1;
-                           break;
-                        }
-                     }
-                     if (is_exit)
-                        fprintf (out, " E ");
-                     else
-                        fprintf (out, "---");
-                     if (stl)
-                     {
-                        if (is_exit)
-                           appendmazedata (" E ");
-                        else
-                           appendmazedata ("---");
-                     }
-                  }
-                  else if (Y == minY)
-                  {
-                     // Bottom border
-                     fprintf (out, "---");
-                     if (stl)
-                        appendmazedata ("---");
-                  }
-                  else
-                  {
-                     // Interior - check if there's a passage up from cell below
-                     if ((maze_viz[X][Y - 1] & FLAGU))
-                        fprintf (out, "   ");  // Passage (no wall)
-                     else
-                        fprintf (out, "---");  // Wall
-                     if (stl)
-                     {
-                        if ((maze_viz[X][Y - 1] & FLAGU))
-                           appendmazedata ("   ");
-                        else
-                           appendmazedata ("---");
-                     }
-                  }
+                  appendmazedata ("\n");
+                  appendmazedata ("============ MAZE WITH SOLUTION ============\n");
+                  appendmazedata ("\n");
+                  appendmazedata ("Legend: S = start, arrows (↑↓←→) show path to exit\n");
+                  appendmazedata ("\n");
                }
-               fprintf (out, "+\n");
-               if (stl)
-                  appendmazedata ("+\n");
-               
-               // Draw vertical walls and cell interiors with solution
-               if (Y > minY)
+            
+               for (Y = maxY + 1; Y >= minY; Y--)
                {
-                  fprintf (out, "// ");
-                  if (stl)
+                  // Draw horizontal walls and corners
+                  viz ("// ");
+                  if (vizdata)
                      appendmazedata (" ");
-                  
                   for (X = 0; X < W; X++)
                   {
-                     // Left edge - check for wrap-around from previous cell
-                     if (X == 0)
+                     viz ("+");
+                     if (vizdata)
+                        appendmazedata ("+");
+                     // Draw horizontal edge between cells
+                     if (Y == maxY + 1)
                      {
-                        // Check if last cell (W-1) has FLAGR (connects to cell 0)
-                        if (maze_viz[W - 1][Y - 1] & FLAGR)
+                        // Top border - check if this is an exit (exits occur at multiples of W/nubs)
+                        int is_exit = 0;
+                        for (int n = 0; n < nubs; n++)
                         {
-                           fprintf (out, " ");  // Passage wrapping from last to first
-                           if (stl)
-                              appendmazedata (" ");
+                           int exit_x = (maxx + n * (W / nubs)) % W;
+                           if (X == exit_x)
+                           {
+                              is_exit = 1;
+                              break;
+                           }
                         }
+                        if (is_exit)
+                           viz (" E ");
                         else
+                           viz ("---");
+                        if (vizdata)
                         {
-                           fprintf (out, "|");  // Wall at left boundary
-                           if (stl)
-                              appendmazedata ("|");
+                           if (is_exit)
+                              appendmazedata (" E ");
+                           else
+                              appendmazedata ("---");
                         }
                      }
-                     
-                     // Cell interior with solution
-                     if (maze_viz[X][Y - 1] & FLAGI)
+                     else if (Y == minY)
                      {
-                        fprintf (out, "###");
-                        if (stl)
-                           appendmazedata ("###");
+                        // Bottom border
+                        viz ("---");
+                        if (vizdata)
+                           appendmazedata ("---");
                      }
                      else
                      {
-                        // Check if this cell is on the solution path
-                        char sol = solution[X][Y - 1];
-                        if (sol == 'S')
-                        {
-                           fprintf (out, " S ");
-                           if (stl)
-                              appendmazedata (" S ");
-                        }
-                        else if (sol == 'U')
+                        // Interior - check if there's a passage up from cell below
+                        if ((maze_viz[X][Y - 1] & FLAGU))
+                           viz ("   ");  // Passage (no wall)
+                        else
+                           viz ("---");  // Wall
+                        if (vizdata)
                         {
-                           fprintf (out, " ↑ ");
-                           if (stl)
-                              appendmazedata (" ↑ ");
+                           if ((maze_viz[X][Y - 1] & FLAGU))
+                              appendmazedata ("   ");
+                           else
+                              appendmazedata ("---");
                         }
-                        else if (sol == 'D')
+                     }
+                  }
+                  viz ("+\n");
+                  if (vizdata)
+                     appendmazedata ("+\n");
+               
+                  // Draw vertical walls and cell interiors with solution
+                  if (Y > minY)
+                  {
+                     viz ("// ");
+                     if (vizdata)
+                        appendmazedata (" ");
+                  
+                     for (X = 0; X < W; X++)
+                     {
+                        // Left edge - check for wrap-around from previous cell
+                        if (X == 0)
                         {
-                           fprintf (out, " ↓ ");
-                           if (stl)
-                              appendmazedata (" ↓ ");
+                           // Check if last cell (W-1) has FLAGR (connects to cell 0)
+                           if (maze_viz[W - 1][Y - 1] & FLAGR)
+                           {
+                              viz (" ");  // Passage wrapping from last to first
+                              if (vizdata)
+                                 appendmazedata (" ");
+                           }
+                           else
+                           {
+                              viz ("|");  // Wall at left boundary
+                              if (vizdata)
+                                 appendmazedata ("|");
+                           }
                         }
-                        else if (sol == 'L')
+                     
+                        // Cell interior with solution
+                        if (maze_viz[X][Y - 1] & FLAGI)
                         {
-                           fprintf (out, " ← ");
-                           if (stl)
-                              appendmazedata (" ← ");
+                           viz ("###");
+                           if (vizdata)
+                              appendmazedata ("###");
                         }
-                        else if (sol == 'R')
+                        else
                         {
-                           fprintf (out, " → ");
-                           if (stl)
-                              appendmazedata (" → ");
+                           // Check if this cell is on the solution path
+                           char sol = solution[X][Y - 1];
+                           if (sol == 'S')
+                           {
+                              viz (" S ");
+                              if (vizdata)
+                                 appendmazedata (" S ");
+                           }
+                           else if (sol == 'U')
+                           {
+                              viz (" ↑ ");
+                              if (vizdata)
+                                 appendmazedata (" ↑ ");
+                           }
+                           else if (sol == 'D')
+                           {
+                              viz (" ↓ ");
+                              if (vizdata)
+                                 appendmazedata (" ↓ ");
+                           }
+                           else if (sol == 'L')
+                           {
+                              viz (" ← ");
+                              if (vizdata)
+                                 appendmazedata (" ← ");
+                           }
+                           else if (sol == 'R')
+                           {
+                              viz (" → ");
+                              if (vizdata)
+                                 appendmazedata (" → ");
+                           }
+                           else if (!reachable[X][Y - 1])
+                           {
+                              // Cell is not reachable from entrance (dead ends, isolated sections)
+                              viz ("###");
+                              if (vizdata)
+                                 appendmazedata ("###");
+                           }
+                           else
+                           {
+                              // Cell is accessible but not on solution (dead ends, traps)
+                              viz ("   ");
+                              if (vizdata)
+                                 appendmazedata ("   ");
+                           }
                         }
-                        else if (!reachable[X][Y - 1])
+                     
+                        // Right edge - check if there's a passage to the right
+                        if (maze_viz[X][Y - 1] & FLAGR)
                         {
-                           // Cell is not reachable from entrance (dead ends, isolated sections)
-                           fprintf (out, "###");
-                           if (stl)
-                              appendmazedata ("###");
+                           viz (" ");  // Passage to right
+                           if (vizdata)
+                              appendmazedata (" ");
                         }
                         else
                         {
-                           // Cell is accessible but not on solution (dead ends, traps)
-                           fprintf (out, "   ");
-                           if (stl)
-                              appendmazedata ("   ");
+                           viz ("|");  // Wall to right
+                           if (vizdata)
+                              appendmazedata ("|");
                         }
                      }
-                     
-                     // Right edge - check if there's a passage to the right
-                     if (maze_viz[X][Y - 1] & FLAGR)
-                     {
-                        fprintf (out, " ");  // Passage to right
-                        if (stl)
-                           appendmazedata (" ");
-                     }
-                     else
-                     {
-                        fprintf (out, "|");  // Wall to right
-                        if (stl)
-                           appendmazedata ("|");
-                     }
+                     viz ("\n");
+                     if (vizdata)
+                        appendmazedata ("\n");
                   }
-                  fprintf (out, "\n");
-                  if (stl)
-                     appendmazedata ("\n");
                }
-            }
-            fprintf (out, "//\n");
-            if (stl)
-               appendmazedata ("\n");
+               viz ("//\n");
+               if (vizdata)
+                  appendmazedata ("\n");
             
+            }
+
             // Machine-readable format
-            fprintf (out, "// Machine-readable maze data:\n");
-            fprintf (out, "// MAZE_START %s %d %d %d %d %d %d %d %d %d\n", inside ? "INSIDE" : "OUTSIDE", W, maxY - minY + 1, maxx, helix, minY, maxY, entrance_x, _exit_x, (maxy_exit >= 0) ? maxy_exit : maxY);
-            if (stl)
+            viz ("// Machine-readable maze data:\n");
+            viz ("// MAZE_START %s %d %d %d %d %d %d %d %d %d\n", inside ? "INSIDE" : "OUTSIDE", W, maxY - minY + 1, maxx, helix, minY, maxY, entrance_x, _exit_x, (maxy_exit >= 0) ? maxy_exit : maxY);
+            if (vizdata)
             {
                appendmazedata ("Machine-readable maze data:\n");
                appendmazedata ("MAZE_START %s %d %d %d %d %d %d %d %d %d\n", inside ? "INSIDE" : "OUTSIDE", W, maxY - minY + 1, maxx, helix, minY, maxY, entrance_x, _exit_x, (maxy_exit >= 0) ? maxy_exit : maxY);
             }
             for (Y = minY; Y <= maxY; Y++)
             {
-               fprintf (out, "// MAZE_ROW %d ", Y);
-               if (stl)
+               viz ("// MAZE_ROW %d ", Y);
+               if (vizdata)
                   appendmazedata ("MAZE_ROW %d ", Y);
                for (X = 0; X < W; X++)
                {
-                  fprintf (out, "%02X", maze_viz[X][Y]);
-                  if (stl)
+                  viz ("%02X", maze_viz[X][Y]);
+                  if (vizdata)
                      appendmazedata ("%02X", maze_viz[X][Y]);
                   if (X < W - 1)
                   {
-                     fprintf (out, " ");
-                     if (stl)
+                     viz (" ");
+                     if (vizdata)
                         appendmazedata (" ");
                   }
                }
-               fprintf (out, "\n");
-               if (stl)
+               viz ("\n");
+               if (vizdata)
                   appendmazedata ("\n");
             }
-            fprintf (out, "// MAZE_END\n");
-            fprintf (out, "//\n");
-            if (stl)
+            viz ("// MAZE_END\n");
+            viz ("//\n");
+            if (annotate == ANNOTATE_COMPACT)
+            {                   // One line
+               fprintf (out, "// MAZE_COMPACT %s %d %d %d %d %d %d %d %d %d", inside ? "INSIDE" : "OUTSIDE", W, maxY - minY + 1, maxx,
+                        helix, minY, maxY, entrance_x, maxx, (maxy_exit >= 0) ? maxy_exit : maxY);
+               for (Y = minY; Y <= maxY; Y++)
+               {
+                  fputc (' ', out);
+                  for (X = 0; X < W; X++)
+                     fprintf (out, "%02X", maze_viz[X][Y]);
+               }
+               fputc ('\n', out);
+            }
+            if (vizdata)
             {
                appendmazedata ("MAZE_END\n");
                appendmazedata ("\n");
             }
+         }
+            stage (STAGE_OTHER);
 
-            int MAXY = height / (mazestep / 4) + 10;
-            struct
-            {                   // Data for each slive
-               // Pre calculated x/y for left side 0=back, 1=recess, 2=front - used to create points
-               double x[3],
-                 y[3];
+            typedef struct
+            {                   // Data for each slice
                // The last points as we work up slice (-ve for recess, 0 for not set yet)
                int l,
                  r;
+               // Where l is in p, and r is in p of the next slice, so each advance only looks at the points passed
+               int ln,
+                 rn;
                // Points from bottom up on this slice in order - used to ensure manifold buy using points that would be skipped
-               int n;           // Points added to p
-               int p[MAXY];
-            } s[W * 4];
-            memset (&s, 0, sizeof (*s) * W * 4);
-            int p[W][H];        // The point start for each usable maze location (0 for not set) - 16 points
-            memset (*p, 0, sizeof (int) * W * H);
-            // Work out pre-sets
-            for (S = 0; S < W * 4; S++)
+               int n,           // Points added to p
+                 max;           // Space in p
+               int *p;
+            } slice_t;
+            slice_t *s = arena_take (&arena, sizeof (*s) * W * 4);
+            // The position 0 mark, if made natively, is a pocket in the top of the wall over slices markS to markS+markn
+            int markS = -1,
+               markn = 0;
+            if (native && !nativeno && markpos0 && part + 1 >= parts && (inside ? part < parts : !mazeinside))
             {
-               double a = M_PI * 2 * (S - 1.5) / W / 4;
-               if (!inside)
-                  a = M_PI * 2 - a;
-               double sa = sin (a),
-                  ca = cos (a);
-               if (inside)
+               const angles_t *t = slice_angles (W * 4, !inside);
+               double a = -markangle () * M_PI / 180,
+                  best = -2;
+               for (S = 0; S < W * 4; S++)
                {
-                  s[S].x[0] = (r + mazethickness + (part < parts ? wallthickness : clearance + 0.01)) * sa;
-                  s[S].y[0] = (r + mazethickness + (part < parts ? wallthickness : clearance + 0.01)) * ca;
-                  s[S].x[1] = (r + mazethickness) * sa;
-                  s[S].y[1] = (r + mazethickness) * ca;
-                  s[S].x[2] = r * sa;
-                  s[S].y[2] = r * ca;
-               } else
+                  double d = (inside && mirrorinside ? -1 : 1) * t->sin[S] * sin (a) + t->cos[S] * cos (a);
+                  if (d > best)
+                  {
+                     best = d;
+                     markS = S;
+                  }
+               }
+               markn = wallthickness * W * 4 / (2 * M_PI * r) + 0.5;
+               if (markn < 1)
+                  markn = 1;
+               markS = (markS - markn / 2 + W * 4) % (W * 4);
+               marked = 1;
+            }
+            int markline (int S)
+            {                   // Which of the pocket's slices S is, or -1
+               int i = (S - markS + W * 4) % (W * 4);
+               return markS >= 0 && i <= markn ? i : -1;
+            }
+            int (*p)[H] = arena_take (&arena, sizeof (int) * W * H);   // The point start for each usable maze location (0 for not set) - 16 points
+            for (X = 0; X < W; X++)
+            {                   // Points on each slice - 3 base, 4 for each usable maze location in the column, 3 top, and back to start
+               int n = 7;
+               for (Y = 0; Y < H; Y++)
+               {
+                  unsigned char v = test (X, Y);
+                  if ((v & FLAGA) && !(v & FLAGI))
+                     n += 4;
+               }
+               for (S = X * 4; S < X * 4 + 4; S++)
+               {
+                  s[S].max = n + (markline (S) >= 0 ? 2 : 0);
+                  s[S].p = arena_take (&arena, sizeof (int) * s[S].max);
+               }
+            }
+            // Pre calculated x/y of each slice for 0=back, 1=recess, 2=front - used to create points
+            double *sx[3],
+              *sy[3];
+            {
+               const angles_t *t = slice_angles (W * 4, !inside);
+               double rs[3] = {
+                  inside ? r + mazethickness + (part < parts ? wallthickness : clearance + 0.01) : r - mazethickness - wallthickness,
+                  inside ? r + mazethickness : r - mazethickness,
+                  r
+               };
+               for (int i = 0; i < 3; i++)
+               {
+                  sx[i] = arena_take (&arena, sizeof (double) * W * 4);
+                  sy[i] = arena_take (&arena, sizeof (double) * W * 4);
+                  for (S = 0; S < W * 4; S++)
+                  {
+                     sx[i][S] = rs[i] * t->sin[S];
+                     sy[i][S] = rs[i] * t->cos[S];
+                  }
+               }
+            }
+            {
+               double xf[6];
+               memcpy (xf, partxf, sizeof (xf));
+               if (inside && mirrorinside)
                {
-                  s[S].x[0] = (r - mazethickness - wallthickness) * sa;
-                  s[S].y[0] = (r - mazethickness - wallthickness) * ca;
-                  s[S].x[1] = (r - mazethickness) * sa;
-                  s[S].y[1] = (r - mazethickness) * ca;
-                  s[S].x[2] = r * sa;
-                  s[S].y[2] = r * ca;
+                  fprintf (out, "mirror([1,0,0])");
+                  xf_mirrorx (xf);
                }
+               polystart (xf);
             }
-            if (inside && mirrorinside)
-               fprintf (out, "mirror([1,0,0])");
             fprintf (out, "polyhedron(");
             // Make points
-            fprintf (out, "points=[");
+            stage (STAGE_POINTS);
+            polylist ("points=[");
             int P = 0;
             void addpoint (int S, double x, double y, double z)
             {
-               fprintf (out, "[%lld,%lld,%lld],", scaled (x), scaled (y), scaled (z));
-               if (s[S].n >= MAXY)
+               polypoint (scaled (x), scaled (y), scaled (z));
+               if (s[S].n >= s[S].max)
                   errx (1, "WTF points %d", S);
                s[S].p[s[S].n++] = P++;
             }
             void addpointr (int S, double x, double y, double z)
             {
-               fprintf (out, "[%lld,%lld,%lld],", scaled (x), scaled (y), scaled (z));
-               if (s[S].n >= MAXY)
+               polypoint (scaled (x), scaled (y), scaled (z));
+               if (s[S].n >= s[S].max)
                   errx (1, "WTF points %d", S);
                s[S].p[s[S].n++] = -(P++);
             }
             int bottom = P;
             // Base points
             for (S = 0; S < W * 4; S++)
-               addpoint (S, s[S].x[0], s[S].y[0], basethickness - clearance);
+               addpoint (S, sx[0][S], sy[0][S], basethickness - clearance);
             for (S = 0; S < W * 4; S++)
-               addpointr (S, s[S].x[1], s[S].y[1], basethickness - clearance);
+               addpointr (S, sx[1][S], sy[1][S], basethickness - clearance);
             for (S = 0; S < W * 4; S++)
-               addpoint (S, s[S].x[2], s[S].y[2], basethickness - clearance);
+               addpoint (S, sx[2][S], sy[2][S], basethickness - clearance);
             {                   // Points for each maze location
                double dy = mazestep * helix / W / 4;    // Step per S
                double my = mazestep / 8;        // Vertical steps
@@ -2274,30 +4170,50 @@ main (int argc, const char *argv[])
                         continue;
                      p[X][Y] = P;
                      for (S = X * 4; S < X * 4 + 4; S++)
-                        addpoint (S, s[S].x[2], s[S].y[2], y + Y * mazestep + dy * S - my * 3);
+                        addpoint (S, sx[2][S], sy[2][S], y + Y * mazestep + dy * S - my * 3);
                      for (S = X * 4; S < X * 4 + 4; S++)
-                        addpointr (S, s[S].x[1], s[S].y[1], y + Y * mazestep + dy * S - my - nubskew);
+                        addpointr (S, sx[1][S], sy[1][S], y + Y * mazestep + dy * S - my - nubskew);
                      for (S = X * 4; S < X * 4 + 4; S++)
-                        addpointr (S, s[S].x[1], s[S].y[1], y + Y * mazestep + dy * S + my - nubskew);
+                        addpointr (S, sx[1][S], sy[1][S], y + Y * mazestep + dy * S + my - nubskew);
                      for (S = X * 4; S < X * 4 + 4; S++)
-                        addpoint (S, s[S].x[2], s[S].y[2], y + Y * mazestep + dy * S + my * 3);
+                        addpoint (S, sx[2][S], sy[2][S], y + Y * mazestep + dy * S + my * 3);
                   }
             }
             int top = P;
             for (S = 0; S < W * 4; S++)
-               addpoint (S, s[S].x[2], s[S].y[2], height - (basewide && !inside && part > 1 ? 0 : margin));     // lower
+               addpoint (S, sx[2][S], sy[2][S], height - (basewide && !inside && part > 1 ? 0 : margin));     // lower
             for (S = 0; S < W * 4; S++)
-               addpoint (S, s[S].x[1], s[S].y[1], height);
+               addpoint (S, sx[1][S], sy[1][S], height);
             for (S = 0; S < W * 4; S++)
-               addpoint (S, s[S].x[0], s[S].y[0], height);
+               addpoint (S, sx[0][S], sy[0][S], height);
+            int markp = P;      // Pocket points, 4 on each slice: top and bottom a quarter from recess, bottom and top a quarter from back
+            for (int i = 0; i <= markn && markS >= 0; i++)
+            {
+               S = (markS + i) % (W * 4);
+               double x1 = (sx[1][S] * 3 + sx[0][S]) / 4,
+                  y1 = (sy[1][S] * 3 + sy[0][S]) / 4,
+                  x0 = (sx[1][S] + sx[0][S] * 3) / 4,
+                  y0 = (sy[1][S] + sy[0][S] * 3) / 4;
+               addpoint (S, x1, y1, height);
+               polypoint (scaled (x1), scaled (y1), scaled (height - mazestep / 4));
+               polypoint (scaled (x0), scaled (y0), scaled (height - mazestep / 4));
+               P += 2;
+               addpoint (S, x0, y0, height);
+               int *q = s[S].p + s[S].n - 3,    // Back, then the two top pocket points, which go between recess and back
+                  b = q[0];
+               q[0] = q[1];
+               q[1] = q[2];
+               q[2] = b;
+            }
             for (S = 0; S < W * 4; S++)
             {                   // Wrap back to start
-               if (s[S].n >= MAXY)
+               if (s[S].n >= s[S].max)
                   errx (1, "WTF points");
                s[S].p[s[S].n++] = S;
             }
             fprintf (out, "]");
             // Make faces
+            stage (STAGE_FACES);
             void slice (int S, int l, int r)
             {                   // Advance slice S to new L and R (-ve for recess)
                inline int abs (int x)
@@ -2316,61 +4232,74 @@ main (int argc, const char *argv[])
                }
                if (S >= W * 4)
                   errx (1, "Bad render %d", S);
+               nslices++;
                char start = 0;
                if (!s[S].l)
                {                // New - draw to bottom
                   s[S].l = (l < 0 ? -1 : 1) * (bottom + S + W * 4 + (l < 0 ? 0 : W * 4));
                   s[S].r = (r < 0 ? -1 : 1) * (bottom + (S + 1) % (W * 4) + W * 4 + (r < 0 ? 0 : W * 4));
-                  fprintf (out, "[%d,%d,%d,%d],", abs (s[S].l), abs (s[S].r), (S + 1) % (W * 4), S);
+                  facestart ();
+                  facepoint (abs (s[S].l));
+                  facepoint (abs (s[S].r));
+                  facepoint ((S + 1) % (W * 4));
+                  facepoint (S);
+                  faceend ();
                }
                // Advance
                if (l == s[S].l && r == s[S].r)
                   return;
                int SR = (S + 1) % (W * 4);
-               fprintf (out, "[");
+               facestart ();
                int p = 0;
                int n1,
                  n2;
-               for (n1 = 0; n1 < s[S].n && abs (s[S].p[n1]) != abs (s[S].l); n1++);
+               for (n1 = s[S].ln; n1 < s[S].n && abs (s[S].p[n1]) != abs (s[S].l); n1++);
                for (n2 = n1; n2 < s[S].n && abs (s[S].p[n2]) != abs (l); n2++);
                if (n1 == s[S].n || n2 == s[S].n)
                   errx (1, "Bad render %d->%d", s[S].l, l);
+               nscan += n2 - s[S].ln;
+               s[S].ln = n2;
                while (n1 < n2)
                {
                   if (sgn (s[S].p[n1]) == sgn (s[S].l))
                   {
-                     fprintf (out, "%d,", abs (s[S].p[n1]));
+                     facepoint (abs (s[S].p[n1]));
                      p++;
                   }
                   n1++;
                }
-               fprintf (out, "%d,", abs (l));
+               facepoint (abs (l));
                if (p)
-                  fprintf (out, "%d],", abs (r));       // Triangles
-               for (n1 = 0; n1 < s[SR].n && abs (s[SR].p[n1]) != abs (s[S].r); n1++);
+               {                // Triangles
+                  facepoint (abs (r));
+                  faceend ();
+               }
+               for (n1 = s[S].rn; n1 < s[SR].n && abs (s[SR].p[n1]) != abs (s[S].r); n1++);
                for (n2 = n1; n2 < s[SR].n && abs (s[SR].p[n2]) != abs (r); n2++);
                if (n1 == s[SR].n || n2 == s[SR].n)
                   errx (1, "Bad render %d->%d", r, s[S].r);
+               nscan += n2 - s[S].rn;
+               s[S].rn = n2;
                if (!p || n1 < n2)
                {
                   n2--;
                   if (p)
-                     fprintf (out, "[");
-                  fprintf (out, "%d", abs (r));
+                     facestart ();
+                  facepoint (abs (r));
                   while (n1 <= n2)
                   {
                      if (sgn (s[SR].p[n2]) == sgn (s[S].r))
-                        fprintf (out, ",%d", abs (s[SR].p[n2]));
+                        facepoint (abs (s[SR].p[n2]));
                      n2--;
                   }
                   if (p)
-                     fprintf (out, ",%d", abs (s[S].l));
-                  fprintf (out, "],");
+                     facepoint (abs (s[S].l));
+                  faceend ();
                }
                s[S].l = l;
                s[S].r = r;
             }
-            fprintf (out, ",\nfaces=[");
+            polylist (",\nfaces=[");
             // Maze
             for (Y = 0; Y < H; Y++)
                for (X = 0; X < W; X++)
@@ -2441,6 +4370,47 @@ main (int argc, const char *argv[])
                //slice (S, (s[S].l < 0 ? -1 : 1) * (top + S + (s[S].l < 0 ? W * 4 : 0)), (s[S].r < 0 ? -1 : 1) * (top + ((S + 1) % (W * 4)) + (s[S].r < 0 ? W * 4 : 0)));
                slice (S, top + S + (s[S].l < 0 ? W * 4 : 0), top + ((S + 1) % (W * 4)) + (s[S].r < 0 ? W * 4 : 0));
                slice (S, top + S + W * 4, top + ((S + 1) % (W * 4)) + W * 4);
+               int ml = markline (S),
+                  mr = markline (S + 1);
+               if (ml >= 0 && ml < markn)
+               {                // Pocket
+                  int L = markp + ml * 4,
+                     R = L + 4;
+                  slice (S, L, R);
+                  if (!ml)
+                  {
+                     facestart ();
+                     for (int i = 3; i >= 0; i--)
+                        facepoint (L + i);
+                     faceend ();
+                  }
+                  for (int i = 0; i < 3; i++)
+                  {
+                     facestart ();
+                     facepoint (L + i);
+                     facepoint (L + i + 1);
+                     facepoint (R + i + 1);
+                     facepoint (R + i);
+                     faceend ();
+                  }
+                  if (ml + 1 == markn)
+                  {
+                     facestart ();
+                     for (int i = 0; i < 4; i++)
+                        facepoint (R + i);
+                     faceend ();
+                  }
+                  s[S].l = L + 3;
+                  s[S].r = R + 3;
+               } else if (ml == markn)
+               {                // Triangles to the pocket's top points, so none are in line
+                  slice (S, markp + ml * 4, top + ((S + 1) % (W * 4)) + W * 4);
+                  slice (S, markp + ml * 4 + 3, top + ((S + 1) % (W * 4)) + W * 4);
+               } else if (!mr)
+               {
+                  slice (S, top + S + W * 4, markp);
+                  slice (S, top + S + W * 4, markp + 3);
+               }
                slice (S, top + S + 2 * W * 4, top + ((S + 1) % (W * 4)) + 2 * W * 4);
                slice (S, bottom + S, bottom + (S + 1) % (W * 4));
             }
@@ -2448,6 +4418,8 @@ main (int argc, const char *argv[])
             fprintf (out, ",convexity=10");
             // Done
             fprintf (out, ");\n");
+            polyend ();
+            stage (STAGE_NUBS);
             if (parkthickness)
             {                   // Park ridge
                // For negative helix the park is at col W/nubs-1 (seg-1). The ridge bumps
@@ -2456,11 +4428,20 @@ main (int argc, const char *argv[])
                // helix straddles the col0/col1 boundary. Shift by (W/nubs-2)*4 so X=0
                // starts at col seg-2 and X=1,2 land on the boundary.
                int park_S_shift = (helix < 0 && !parkvertical ? (W / nubs - 2) * 4 : 0);
-               if (inside && mirrorinside)
-                  fprintf (out, "mirror([1,0,0])");
-               fprintf (out, "polyhedron(points=[");
+               {
+                  double xf[6];
+                  memcpy (xf, partxf, sizeof (xf));
+                  if (inside && mirrorinside)
+                  {
+                     fprintf (out, "mirror([1,0,0])");
+                     xf_mirrorx (xf);
+                  }
+                  polystart (xf);
+               }
+               mesh_t *park = mesh;     // Native mesh has the first ridge, and the others are copies of it
+               polylist ("polyhedron(points=[");
                for (N = 0; N < W; N += W / nubs)
-                  for (Y = 0; Y < 4; Y++)
+                  for (mesh = (N ? NULL : park), Y = 0; Y < 4; Y++)
                      for (X = 0; X < 4; X++)
                      {
                         int S = (N * 4 + X + park_S_shift + (parkvertical ? 0 : 2) + W * 4) % (W * 4);
@@ -2468,28 +4449,34 @@ main (int argc, const char *argv[])
                            y0 - dy * 1.5 / 4 + (abs_helix + 1) * mazestep + Y * mazestep / 4 + dy * X / 4 +
                            (parkvertical ? mazestep / 8 : dy / 2 - mazestep * 3 / 8) +
                            (helix < 0 && !parkvertical ? mazestep + dy * (W / nubs - 2) : 0); // neg: +1 row, X=0 starts at col seg-2
-                        double x = s[S].x[1];
-                        double y = s[S].y[1];
+                        double x = sx[1][S];
+                        double y = sy[1][S];
                         if (parkvertical ? Y == 1 || Y == 2 : X == 1 || X == 2)
                         {       // ridge height instead of surface
-                           x = (s[S].x[1] * (mazethickness - parkthickness) + s[S].x[2] * parkthickness) / mazethickness;
-                           y = (s[S].y[1] * (mazethickness - parkthickness) + s[S].y[2] * parkthickness) / mazethickness;
+                           x = (sx[1][S] * (mazethickness - parkthickness) + sx[2][S] * parkthickness) / mazethickness;
+                           y = (sy[1][S] * (mazethickness - parkthickness) + sy[2][S] * parkthickness) / mazethickness;
                         } else if (parkvertical)
                            z -= nubskew;
-                        fprintf (out, "[%lld,%lld,%lld],", scaled (s[S].x[0]), scaled (s[S].y[0]), scaled (z));
-                        fprintf (out, "[%lld,%lld,%lld],", scaled (x), scaled (y), scaled (z));
+                        polypoint (scaled (sx[0][S]), scaled (sy[0][S]), scaled (z));
+                        polypoint (scaled (x), scaled (y), scaled (z));
                      }
-               fprintf (out, "],faces=[");
+               polylist ("],faces=[");
                for (N = 0; N < nubs; N++)
                {
                   int P = N * 32;
+                  mesh = (N ? NULL : park);
                   inline void add (int a, int b, int c, int d)
                   {  // For negative helix the park ridge has reversed z-slope (dy<0),
                      // which inverts face normals vs positive helix. Flip winding to correct.
                      if (helix < 0 && !parkvertical)
-                        fprintf (out, "[%d,%d,%d],[%d,%d,%d],", P + a, P + c, P + b, P + a, P + d, P + c);
-                     else
-                        fprintf (out, "[%d,%d,%d],[%d,%d,%d],", P + a, P + b, P + c, P + a, P + c, P + d);
+                     {
+                        facetri (P + a, P + c, P + b);
+                        facetri (P + a, P + d, P + c);
+                     } else
+                     {
+                        facetri (P + a, P + b, P + c);
+                        facetri (P + a, P + c, P + d);
+                     }
                   }
                   for (X = 0; X < 6; X += 2)
                   {
@@ -2508,6 +4495,10 @@ main (int argc, const char *argv[])
                   }
                }
                fprintf (out, "],convexity=10);\n");
+               mesh = park;
+               polyend ();
+               if (park)
+                  copies (park, polyxf);
             }
       }
 
@@ -2524,7 +4515,7 @@ main (int argc, const char *argv[])
       {                         // Marking position 0
          if (!markpos0 || part + 1 < parts)
             return;
-         double a = 0,
+         double a = markangle (),
             r = part_r0 + wallthickness / 2,
             t = wallthickness * 2;
          if (mazeinside)
@@ -2536,49 +4527,50 @@ main (int argc, const char *argv[])
             r -= wallthickness / 2;
             t = wallthickness * 3 / 2;
          }
-         if (part == parts && mazeinside)
-            a = (mirrorinside ? 1 : -1) * part_entrya;
-         if (part + 1 == parts && mazeoutside)
-            a = part_entrya;
+         if (marked)
+            dynamicmark ();     // Made natively, so not in the static part
          fprintf (out, "rotate([0,0,%f])translate([0,%lld,%lld])cylinder(d=%lld,h=%lld,center=true,$fn=4);\n", a, scaled (r),
                   scaled (height), scaled (t), scaled (mazestep / 2));
+         if (marked)
+            dynamicmark ();
       }
 
       // Maze
       fprintf (out, "// Maze\ndifference(){union(){");
+      dynamicmark ();
+      TRACE1 (maze_start, part);
       if (mazeinside)
          makemaze (part_r0, 1);
       if (mazeoutside)
          makemaze (part_r1, 0);
+      TRACE1 (maze_done, part);
+      dynamicmark ();
+      stage (STAGE_OTHER);
       if (!mazeinside && !mazeoutside && part < parts)
       {
          fprintf (out, "difference(){\n");
-         fprintf (out, "translate([0,0,%lld])cylinder(r=%lld,h=%lld,$fn=%d);translate([0,0,%lld])cylinder(r=%lld,h=%lld,$fn=%d);\n", scaled (basethickness / 2 - clearance), scaled (part_r1), scaled (height - basethickness / 2 + clearance), W * 4, scaled (basethickness), scaled (part_r0), scaled (height), W * 4); // Non maze
+         fprintf (out, "translate([0,0,%lld])cylinder(r=%lld,h=%lld,$fn=%d);translate([0,0,%lld])cylinder(r=%lld,h=%lld,$fn=%d);\n", scaled (basethickness / 2 - clearance), scaled (part_r1), scaled (height - basethickness / 2 + clearance), W * fnscale, scaled (basethickness), scaled (part_r0), scaled (height), W * fnscale); // Non maze
          fprintf (out, "}\n");
       }
       // Base
       fprintf (out, "// BASE\ndifference(){\n");
       if (part == parts)
-         fprintf (out, "outer(%lld,%lld);\n",
-		  scaled (height),
-                  scaled ((part_r2 - outerround) / cos ((double) M_PI / (outersides ? : 100)))
-		  );
+         outer (height, (part_r2 - outerround) / cos ((double) M_PI / (outersides ? : 100)));
       else if (part + 1 >= parts)
-         fprintf (out, "mirror([1,0,0])outer(%lld,%lld);\n",
-		  scaled (baseheight),
-                  scaled ((part_r2 - outerround) / cos ((double) M_PI / (outersides ? : 100)))
-		  );
-      else
+      {
+         fprintf (out, "mirror([1,0,0])");
+         outer (baseheight, (part_r2 - outerround) / cos ((double) M_PI / (outersides ? : 100)));
+      } else
          fprintf (out, "hull(){cylinder(r=%lld,h=%lld,$fn=%d);translate([0,0,%lld])cylinder(r=%lld,h=%lld,$fn=%d);}\n",
                   scaled (part_r2 - mazethickness),
 		  scaled (baseheight),
-		  W * 4,
+		  W * fnscale,
 		  scaled (mazemargin),
 		  scaled (part_r2),
                   scaled (baseheight - mazemargin),
-		  W * 4
+		  W * fnscale
 		  );
-      fprintf (out, "translate([0,0,%lld])cylinder(r=%lld,h=%lld,$fn=%d);\n", scaled (basethickness), scaled (part_r0 + (part > 1 && mazeinside ? mazethickness + clearance : 0) + (!mazeinside && part < parts ? clearance : 0)), scaled (height), W * 4);  // Hole
+      fprintf (out, "translate([0,0,%lld])cylinder(r=%lld,h=%lld,$fn=%d);\n", scaled (basethickness), scaled (part_r0 + (part > 1 && mazeinside ? mazethickness + clearance : 0) + (!mazeinside && part < parts ? clearance : 0)), scaled (height), W * fnscale);  // Hole
       fprintf (out, "}\n");
       fprintf (out, "}\n");
       if (gripdepth)
@@ -2595,6 +4587,103 @@ main (int argc, const char *argv[])
                      scaled (outerround + (baseheight - outerround) / 2), outersides ? : 100, scaled (part_r3 + gripdepth),
                      scaled (gripdepth * 2));
       }
+      if (native && !nativeno && !nativestatic)
+      {                         // Native meshes for the parts that are not a polyhedron, all solids of revolution
+         double rz[64];
+         int n = 0;
+         void pt (double r, double z)
+         {
+            rz[n * 2] = r;
+            rz[n * 2 + 1] = z;
+            n++;
+         }
+         if (!mazeinside && !mazeoutside && part < parts)
+         {                      // Non maze
+            pt (0, basethickness / 2 - clearance);
+            pt (part_r1, basethickness / 2 - clearance);
+            pt (part_r1, height);
+            pt (part_r0, height);
+            pt (part_r0, basethickness);
+            pt (0, basethickness);
+            mesh_revolve (mesh_new (&meshes, part), n, rz, W * 4, partxf, 0, 0, 0);
+            if (markpos0 && part + 1 == parts)
+               nativeno = "mark";       // Cut in this wall
+         }
+         // Base
+         n = 0;
+         double top = baseheight;
+         pt (0, 0);
+         if (part + 1 >= parts)
+         {                      // outer()
+            double r = (part_r2 - outerround) / cos ((double) M_PI / (outersides ? : 100));
+            if (part == parts)
+               top = height;
+            pt (r, 0);
+            pt (r + outerround, outerround);
+            pt (r + outerround, top);
+         } else
+         {                      // hull()
+            pt (part_r2 - mazethickness, 0);
+            pt (part_r2, mazemargin);
+            pt (part_r2, baseheight);
+         }
+         double hole = part_r0 + (part > 1 && mazeinside ? mazethickness + clearance : 0) + (!mazeinside && part < parts ? clearance : 0);
+         for (int i = 1; i < n; i++)
+            if (rz[i * 2 + 1] >= basethickness && rz[i * 2] <= hole)
+               nativeno = "hole";
+         int rim = n;           // Top of the wall, for the mark
+         if (basethickness < top)
+         {
+            pt (hole, top);
+            pt (hole, basethickness);
+            pt (0, basethickness);
+         } else
+            pt (0, top);
+         if (gripdepth && part + 1 <= parts)
+         {                      // Cut outs, circle $fn=9
+            double g[18],
+              gr = (part + 1 < parts ? part_r2 : part_r3) + gripdepth,
+               gz = (part + 1 < parts ? mazemargin + (baseheight - mazemargin) / 2 : outerround + (baseheight - outerround) / 2);
+            for (int i = 0; i < 9; i++)
+            {
+               g[i * 2] = gr + gripdepth * 2 * cos (2 * M_PI * i / 9);
+               g[i * 2 + 1] = gz + gripdepth * 2 * sin (2 * M_PI * i / 9);
+            }
+            if (profile_cut (rz, &n, sizeof (rz) / sizeof (*rz) / 2, g, 9))
+               nativeno = "grip";
+         }
+         int segs = (W * 4 < 100 ? 100 : W * 4);
+         double xf[6];
+         memcpy (xf, partxf, sizeof (xf));
+         if (outersides && part + 1 >= parts)
+         {                      // The polygon's corners are on the segments, and it is mirrored as the outer() for the lid
+            segs = (segs + outersides - 1) / outersides * outersides;
+            if (part < parts)
+               xf_mirrorx (xf);
+         }
+         mesh_t *m = mesh_new (&meshes, part);
+         mesh_revolve (m, n, rz, segs, xf, part + 1 >= parts ? outersides : 0, hole, outerround);
+         if (markpos0 && part == parts && !mazeinside && basethickness < top)
+         {                      // Mark on the top of the wall, the quad from rim-1 to rim in the segment at the mark's angle
+            int v = 0;
+            for (int i = 0; i < rim - 1; i++)
+               v += (rz[i * 2] > 0 ? segs : 1);
+            int j = ((int) floor ((90 + markangle ()) / 360 * segs) % segs + segs) % segs,
+               j2 = (j + 1) % segs;
+            if (mesh_pocket (m, (int[4]) { v + j, v + j2, v + segs + j2, v + segs + j }, mazestep / 4))
+               nativeno = "mark";
+         }
+         if (coresolid && part == 1)
+         {                      // Solid core
+            double r = part_r0 + clearance + (!mazeinside && part < parts ? clearance : 0);
+            n = 0;
+            pt (0, basethickness);
+            pt (r, basethickness);
+            pt (r, height);
+            pt (0, height);
+            mesh_revolve (mesh_new (&meshes, part), n, rz, W * 4, partxf, 0, 0, 0);
+         }
+      }
       if (basewide && nextoutside && part + 1 < parts)  // Connect endpoints over base
       {
          int W = ((int) ((part_r2 - mazethickness) * 2 * M_PI / mazestep)) / nubs * nubs;
@@ -2606,7 +4695,7 @@ main (int argc, const char *argv[])
              (double) 360 / nubs, scaled (part_r2), scaled (wi), scaled (mazethickness * 2), scaled (baseheight * 2 + clearance),
              scaled (wo), scaled (baseheight * 2 + clearance));
       }
-      if (textend)
+      if (textend && !preview)
       {
 	fprintf(out, "// Text End\n");
          int n = 0;
@@ -2653,14 +4742,14 @@ main (int argc, const char *argv[])
          }
       }
 
-      if (textsides && part == parts && outersides && !textoutset)
+      if (textsides && part == parts && outersides && !textoutset && !preview)
          textside (0);
-      if (ajklogo && part == parts)
+      if (ajklogo && part == parts && !preview)
          fprintf (out, "translate([0,0,%lld])logo(%lld);\n", scaled (basethickness - logodepth), scaled (part_r0 * 1.8));
-      else if (aalogo && part == parts)
+      else if (aalogo && part == parts && !preview)
          fprintf (out, "translate([0,0,%lld])linear_extrude(height=%lld,convexity=10)logo(%lld,white=true);\n",
                   scaled (basethickness - logodepth), scaled (logodepth * 2), scaled (part_r0 * 1.8));
-      else if (textinside)
+      else if (textinside && !preview)
          fprintf
             (out,
              "translate([0,0,%lld])linear_extrude(height=%lld,convexity=10)text(\"%s\",font=\"%s\",size=%lld,halign=\"center\",valign=\"center\");\n",
@@ -2668,10 +4757,10 @@ main (int argc, const char *argv[])
       if (markpos0 && part + 1 >= parts)
          mark ();
       fprintf (out, "}\n");
-      if (textsides && part == parts && outersides && textoutset)
+      if (textsides && part == parts && outersides && textoutset && !preview)
          textside (1);
       if (coresolid && part == 1)
-         fprintf (out, "translate([0,0,%lld])cylinder(r=%lld,h=%lld,$fn=%d);\n", scaled (basethickness), scaled (part_r0 + clearance + (!mazeinside && part < parts ? clearance : 0)), scaled (height - basethickness), W * 4);      // Solid core
+         fprintf (out, "translate([0,0,%lld])cylinder(r=%lld,h=%lld,$fn=%d);\n", scaled (basethickness), scaled (part_r0 + clearance + (!mazeinside && part < parts ? clearance : 0)), scaled (height - basethickness), W * fnscale);      // Solid core
       if ((mazeoutside && !flip && !flip_stagger && part == parts) || (!mazeoutside && part + 1 == parts))
          part_entrya = 0;            // Align for lid alignment
       else if (fixnubs)
@@ -2682,10 +4771,7 @@ main (int argc, const char *argv[])
       }
       else if (part < parts && !basewide)
       {                         // We can position randomly
-         int v;
-         if (read (f, &v, sizeof (v)) != sizeof (v))
-            err (1, "Read /dev/random");
-         part_entrya = v % 360;
+         part_entrya = pb_rng_range (&rng, 360);
       }
       part_entryas[part] = part_entrya;
       part_mazeexits[part] = part_mazeexit;
@@ -2712,107 +4798,518 @@ main (int argc, const char *argv[])
             my = -my;           // This is nub outside which is for inside maze
          double a = -da * 1.5;  // Centre A
          double z = height - mazestep / 2 - (parkvertical ? 0 : mazestep / 8) - dz * 1.5 - my * 1.5 - nubdistance;    // Centre Z
-         fprintf (out, "rotate([0,0,%f])for(a=[0:%f:359])rotate([0,0,a])polyhedron(points=[", part_entrya, (double) 360 / nubs);
+         fprintf (out, "rotate([0,0,%f])polyhedron(points=[", part_entrya);
+         long long pts[32][3];  // Points, kept for making native mesh for each nub
+         int np = 0;
          r += (inside ? nubrclearance : -nubrclearance);        // Extra gap
          ri += (inside ? nubrclearance : -nubrclearance);       // Extra gap
+         double sa[4],
+           ca[4];
+         for (X = 0; X < 4; X++)
+         {
+            sa[X] = sin (a + da * X);
+            ca[X] = cos (a + da * X);
+         }
          for (Z = 0; Z < 4; Z++)
             for (X = 0; X < 4; X++)
-               fprintf (out, "[%lld,%lld,%lld],", scaled (((X == 1 || X == 2) && (Z == 1 || Z == 2) ? ri : r) * sin (a + da * X)),
-                        scaled (((X == 1 || X == 2)
-                                 && (Z == 1 || Z == 2) ? ri : r) * cos (a + da * X)), scaled (z + Z * dz + X * my + (Z == 1
-                                                                                                                     || Z ==
-                                                                                                                     2 ? nubskew :
-                                                                                                                     0)));
+            {
+               pts[np][0] = scaled (((X == 1 || X == 2) && (Z == 1 || Z == 2) ? ri : r) * sa[X]);
+               pts[np][1] = scaled (((X == 1 || X == 2) && (Z == 1 || Z == 2) ? ri : r) * ca[X]);
+               pts[np][2] = scaled (z + Z * dz + X * my + (Z == 1 || Z == 2 ? nubskew : 0));
+               np++;
+            }
          r += (inside ? clearance - nubrclearance : -clearance + nubrclearance);        // Back in to wall
          for (Z = 0; Z < 4; Z++)
             for (X = 0; X < 4; X++)
-               fprintf (out, "[%lld,%lld,%lld],", scaled (r * sin (a + da * X)), scaled (r * cos (a + da * X)),
-                        scaled (z + Z * dz + X * my + (Z == 1 || Z == 2 ? nubskew : 0)));
+            {
+               pts[np][0] = scaled (r * sa[X]);
+               pts[np][1] = scaled (r * ca[X]);
+               pts[np][2] = scaled (z + Z * dz + X * my + (Z == 1 || Z == 2 ? nubskew : 0));
+               np++;
+            }
+         for (int n = 0; n < nubs; n++)
+         {                      // The nub and its copies round, as one polyhedron rather than a union for openscad to do
+            double xf[6] = { 1, 0, 0, 0, 1, 0 };
+            xf_rotate (xf, (double) 360 * n / nubs);
+            for (int i = 0; i < np; i++)
+            {
+               double x = pts[i][0],
+                  y = pts[i][1];
+               xf_apply (xf, &x, &y);
+               out_3 (out, n ? (long long[3]) { llround (x), llround (y), pts[i][2] } : pts[i]);
+            }
+         }
+         npoints += np * nubs;
          fprintf (out, "],faces=[");
+         int faces[60][3],
+           nf = 0;
+         void face (int a, int b, int c)
+         {
+            faces[nf][0] = a;
+            faces[nf][1] = b;
+            faces[nf][2] = c;
+            nf++;
+         }
          for (Z = 0; Z < 3; Z++)
             for (X = 0; X < 3; X++)
-               fprintf (out, "[%d,%d,%d],[%d,%d,%d],", Z * 4 + X + 20, Z * 4 + X + 21, Z * 4 + X + 17, Z * 4 + X + 20,
-                        Z * 4 + X + 17, Z * 4 + X + 16);
+            {
+               face (Z * 4 + X + 20, Z * 4 + X + 21, Z * 4 + X + 17);
+               face (Z * 4 + X + 20, Z * 4 + X + 17, Z * 4 + X + 16);
+            }
          for (Z = 0; Z < 3; Z++)
-            fprintf (out, "[%d,%d,%d],[%d,%d,%d],[%d,%d,%d],[%d,%d,%d],", Z * 4 + 4, Z * 4 + 20, Z * 4 + 16, Z * 4 + 4, Z * 4 + 16,
-                     Z * 4 + 0, Z * 4 + 23, Z * 4 + 7, Z * 4 + 3, Z * 4 + 23, Z * 4 + 3, Z * 4 + 19);
+         {
+            face (Z * 4 + 4, Z * 4 + 20, Z * 4 + 16);
+            face (Z * 4 + 4, Z * 4 + 16, Z * 4 + 0);
+            face (Z * 4 + 23, Z * 4 + 7, Z * 4 + 3);
+            face (Z * 4 + 23, Z * 4 + 3, Z * 4 + 19);
+         }
          for (X = 0; X < 3; X++)
-            fprintf (out, "[%d,%d,%d],[%d,%d,%d],[%d,%d,%d],[%d,%d,%d],", X + 28, X + 12, X + 13, X + 28, X + 13, X + 29, X + 0,
-                     X + 16, X + 17, X + 0, X + 17, X + 1);
-         fprintf (out, "[0,1,5],[0,5,4],[4,5,9],[4,9,8],[8,9,12],[9,13,12],");
-         fprintf (out, "[1,2,6],[1,6,5],[5,6,10],[5,10,9],[9,10,14],[9,14,13],");
-         fprintf (out, "[2,3,6],[3,7,6],[6,7,11],[6,11,10],[10,11,15],[10,15,14],");
+         {
+            face (X + 28, X + 12, X + 13);
+            face (X + 28, X + 13, X + 29);
+            face (X + 0, X + 16, X + 17);
+            face (X + 0, X + 17, X + 1);
+         }
+         static const int top[18][3] = {
+            {0, 1, 5}, {0, 5, 4}, {4, 5, 9}, {4, 9, 8}, {8, 9, 12}, {9, 13, 12},
+            {1, 2, 6}, {1, 6, 5}, {5, 6, 10}, {5, 10, 9}, {9, 10, 14}, {9, 14, 13},
+            {2, 3, 6}, {3, 7, 6}, {6, 7, 11}, {6, 11, 10}, {10, 11, 15}, {10, 15, 14},
+         };
+         for (int i = 0; i < 18; i++)
+            face (top[i][0], top[i][1], top[i][2]);
+         for (int n = 0; n < nubs; n++)
+            for (int i = 0; i < nf; i++)
+               out_3 (out, (long long[3]) { faces[i][0] + n * np, faces[i][1] + n * np, faces[i][2] + n * np });
+         nfaces += nf * nubs;
          fprintf (out, "]);\n");
+         if (native && !nativeno)
+         {                      // One mesh for the first nub, and the others are copies of it
+            double xf[6];
+            memcpy (xf, partxf, sizeof (xf));
+            xf_rotate (xf, part_entrya);
+            mesh_t *m = mesh_new (&meshes, part);
+            for (int i = 0; i < np; i++)
+            {
+               double x = (double) pts[i][0] / SCALE,
+                  y = (double) pts[i][1] / SCALE;
+               xf_apply (xf, &x, &y);
+               mesh_point (m, x, y, (double) pts[i][2] / SCALE);
+            }
+            for (int i = 0; i < nf; i++)
+               mesh_face (m, 3, faces[i], !xf_flipped (xf));
+            copies (m, xf);
+         }
       }
 
+      stage (STAGE_NUBS);
+      dynamicmark ();
       if (!mazeinside && part > 1)
          addnub (part_r0, 1);
       if (!mazeoutside && part < parts)
          addnub (part_r1, 0);
+      dynamicmark ();
+      stage (STAGE_OTHER);
       fprintf (out, "}\n");
-      x += (outersides & 1 ? part_r3 : part_r2) + part_r2 + 5;
+      return 0;
+   }
+   int split = (stl && renderparts && !part && parts > 1 && !(native && !nativeno));      // Render each part on its own
+   char *partscad[parts + 1];   // Each part's SCAD, if split
+   memset (partscad, 0, sizeof (partscad));
+   long prelude = 0;            // SCAD before the parts, if split or nativestatic
+   /**
+    * Makes a part (see box), or with --cache-dir uses the part made before from the same inputs - so changing
+    * something only on one part, such as side text, only makes that part again. The SCAD, the maze data, the
+    * native meshes and the nub angles from the part are kept, in a cache file hh...hh.part. Then moves on to
+    * where the next part goes.
+    *
+    * @param part Part number
+    */
+   void makepart (int part)
+   {
+      char *partfile = NULL;
+      if (cachedir && seeded && !savemazeinside && !savemazeoutside && !mazejson && !nativestatic)
+      {
+         double in[] = { part_r0s[part], part_r1s[part], part_r2s[part], part_r3s[part], x, y, globalexit };
+         unsigned long long h = fnv64 (cachekey (part), in, sizeof (in));
+         h = fnv64 (h, &part, sizeof (part));
+         if (asprintf (&partfile, "%s/%016llx.part", cachedir, h) < 0)
+            errx (1, "malloc");
+      }
+      FILE *f = (partfile ? fopen (partfile, "r") : NULL);
+      int hit = 0;
+      if (f)
+      {                         // Cached part
+         char magic[4];
+         size_t fraglen,
+           datalen;
+         int nmesh;
+         double angles[3];
+         if (fread (magic, 4, 1, f) == 1 && !memcmp (magic, "PBP1", 4) && fread (&fraglen, sizeof (fraglen), 1, f) == 1
+             && fread (&datalen, sizeof (datalen), 1, f) == 1 && fread (&nmesh, sizeof (nmesh), 1, f) == 1
+             && fread (angles, sizeof (angles), 1, f) == 1)
+         {
+            char *frag = malloc (fraglen + datalen + 1);
+            if (!frag)
+               errx (1, "malloc");
+            if (fread (frag, 1, fraglen + datalen, f) == fraglen + datalen)
+            {
+               hit = 1;
+               mesh_t **tail = &meshes;
+               while (*tail)
+                  tail = &(*tail)->next;
+               for (int i = 0; i < nmesh && hit; i++)
+                  if (mesh_read (f, tail))
+                     hit = 0;
+               if (hit)
+               {
+                  fwrite (frag, fraglen, 1, out);
+                  if (split && !(partscad[part] = strndup (frag, fraglen)))
+                     errx (1, "malloc");
+                  frag[fraglen + datalen] = 0;
+                  if (datalen)
+                     appendmazedata ("%s", frag + fraglen);
+                  globalexit = angles[0];
+                  part_entryas[part] = angles[1];
+                  part_mazeexits[part] = angles[2];
+                  utimensat (AT_FDCWD, partfile, NULL, 0);      // Recently used
+               } else
+               {                // Bad file, make the part
+                  mesh_free (*tail);
+                  *tail = NULL;
+               }
+            }
+            free (frag);
+         }
+         fclose (f);
+      }
+      if (!hit)
+      {
+         FILE *real = out;
+         char *frag = NULL;
+         size_t fraglen = 0,
+            data = mazedatasize;
+         int nmesh = 0;
+         mesh_t *last = meshes;
+         while (last && last->next)
+            last = last->next;
+         if ((partfile || split || nativestatic) && !(out = open_memstream (&frag, &fraglen)))
+            err (1, "open_memstream");
+         ndynamic = 0;
+         TRACE1 (box_start, part);
+         box (part);
+         TRACE1 (box_done, part);
+         if (partfile || split || nativestatic)
+         {
+            fclose (out);
+            out = real;
+            fwrite (frag, fraglen, 1, out);
+         }
+         if (nativestatic)
+         {                      // The static part is the SCAD without the mazes and nubs
+            size_t to = 0,
+               from = 0;
+            for (int i = 0; i <= ndynamic; i += 2)
+            {
+               size_t end = (i < ndynamic ? (size_t) dynamic[i] : fraglen);
+               memmove (frag + to, frag + from, end - from);
+               to += end - from;
+               if (i + 1 < ndynamic)
+                  from = dynamic[i + 1];
+            }
+            frag[to] = 0;
+         }
+         if (partfile)
+         {
+            char *tmp = NULL;
+            if (asprintf (&tmp, "%s.%d", partfile, getpid ()) < 0)
+               errx (1, "malloc");
+            if ((f = fopen (tmp, "w")))
+            {
+               size_t datalen = mazedatasize - data;
+               mesh_t *m;
+               for (m = (last ? last->next : meshes); m; m = m->next)
+                  nmesh++;
+               double angles[3] = { globalexit, part_entryas[part], part_mazeexits[part] };
+               fwrite ("PBP1", 4, 1, f);
+               fwrite (&fraglen, sizeof (fraglen), 1, f);
+               fwrite (&datalen, sizeof (datalen), 1, f);
+               fwrite (&nmesh, sizeof (nmesh), 1, f);
+               fwrite (angles, sizeof (angles), 1, f);
+               fwrite (frag, 1, fraglen, f);
+               if (datalen)
+                  fwrite (mazedata + data, 1, datalen, f);
+               for (m = (last ? last->next : meshes); m; m = m->next)
+                  mesh_write (f, m);
+               if (fclose (f) || rename (tmp, partfile))
+                  unlink (tmp);
+            }
+            free (tmp);
+         }
+         if (split || nativestatic)
+            partscad[part] = frag;
+         else
+            free (frag);
+      }
+      free (partfile);
+      x += (outersides & 1 ? part_r3s[part] : part_r2s[part]) + part_r2s[part] + 5;
       if (++n >= sq)
       {
          n = 0;
          x = 0;
-         y += (outersides & 1 ? part_r3 : part_r2) * 2 + 5;
+         y += (outersides & 1 ? part_r3s[part] : part_r2s[part]) * 2 + 5;
       }
    }
 
+   if (split || nativestatic)
+   {
+      fflush (out);
+      prelude = scad.n;
+   }
    fprintf (out, "scale(" SCALEI "){\n");
    if (part)
-      box (part);
+      makepart (part);
    else
       for (part = 1; part <= parts; part++)
-         box (part);
+         makepart (part);
    fprintf (out, "}\n");
-   close (f);
-   if (out != stdout)
-      fclose (out);
+   fclose (out);
+   long bytes = scad.n;         // SCAD size
+   if (scad.f != stdout)
+      fclose (scad.f);
+   else
+      fflush (stdout);
 
-   if (stl)
+   double renderwait = 0;       // Time waiting for render slot
+   int renderqueue = 0;         // Queue depth when waiting started
+   void done (void)
+   {                            // Free what is left
+      for (int p = 0; p <= parts; p++)
+         free (partscad[p]);
+      if (mazedata)
+         free (mazedata);
+      mesh_free (meshes);
+      free (facev);
+      arena_free (&arena);
+   }
+   if (sink && nativeno)
    {
-      // OpenSCAD is a resource hog, so one at a time. Lock releases on file close on exit
-      flock (open ("/var/lock/puzzlebox", O_CREAT, 0666), LOCK_EX);
-      char tmp2[] = "/tmp/XXXXXX.stl";
-      if (!outfile)
+      warnx ("Cannot make meshes (%s)", nativeno);
+      done ();
+      return 1;
+   }
+   if (stl && native && nativeno)
+      warnx ("Cannot make stl directly (%s), using openscad", nativeno);
+   void meshout (void)
+   {                            // Write the meshes, STL, or 3MF or zip if out-file is .3mf or .zip
+      FILE *o = stdout;
+      if (outfile && !(o = fopen (outfile, "w")))
+         err (1, "Cannot open %s", outfile);
+      const char *ext = (outfile && strlen (outfile) > 4 ? outfile + strlen (outfile) - 4 : "");
+      if (!strcasecmp (ext, ".3mf"))
+         mesh_write_3mf (o, meshes);
+      else if (!strcasecmp (ext, ".zip"))
+         mesh_write_zip (o, meshes);
+      else
+         mesh_write_stl (o, meshes, 0);
+      if (o != stdout)
+         fclose (o);
+      else
+         fflush (o);
+   }
+   void meshsink (void)
+   {                            // Each mesh to the sink, copies with their own points
+      for (mesh_t * m = meshes; m; m = m->next)
       {
-         int o = mkstemps (tmp2, 4);
-         if (o < 0)
-            err (1, "Bad tmp");
-         close (o);
-      }
-      pid_t pid = fork ();
-      if (pid < 0)
-         err (1, "bad fork");
-      if (!pid)
-      {                         // Child
-         execlp ("openscad", "openscad", "-q", tmp, "-o", outfile ? : tmp2, NULL);
-         exit (0);
+         const mesh_t *s = (m->of ? : m);
+         if (!m->of)
+         {
+            sink (ctx, m->part, s->np, s->p, s->nt, s->t);
+            continue;
+         }
+         double *p = malloc (sizeof (*p) * 3 * s->np);
+         int *t = malloc (sizeof (*t) * 3 * s->nt),
+            flip = xf_flipped (m->xf);
+         if (!p || !t)
+            errx (1, "malloc");
+         memcpy (p, s->p, sizeof (*p) * 3 * s->np);
+         for (int i = 0; i < s->np; i++)
+            xf_apply (m->xf, &p[i * 3], &p[i * 3 + 1]);
+         for (int i = 0; i < s->nt; i++)
+            for (int j = 0; j < 3; j++)
+               t[i * 3 + j] = s->t[i * 3 + (flip && j ? 3 - j : j)];
+         sink (ctx, m->part, s->np, p, s->nt, t);
+         free (p);
+         free (t);
       }
-      int status = 0;
-      waitpid (pid, &status, 0);
-      unlink (tmp);
-      if (!WIFEXITED (status) || WEXITSTATUS (status))
+   }
+   if (stl)
+   {
+      if (sink)
+      {                         // Direct from meshes, to the sink
+         stage (STAGE_OUTPUT);
+         meshsink ();
+      } else if (native && !nativeno && !nativestatic)
+      {                         // Direct from meshes
+         scad_temp_done (tmp, tmpkeep);
+         stage (STAGE_OUTPUT);
+         meshout ();
+      } else if (split || nativestatic)
+      {                         // Each part rendered on its own, at once up to render slots, then merged
+         // With nativestatic the parts are the SCAD without mazes and nubs, kept in the cache as hh...hh.static.stl
+         stage (STAGE_RENDER);
+         char *head = malloc (prelude + 1);
+         FILE *f = fopen (tmp, "r");
+         if (!head || !f || fread (head, 1, prelude, f) != (size_t) prelude)
+            err (1, "Cannot read %s", tmp);
+         fclose (f);
+         scad_temp_done (tmp, tmpkeep);
+         if (nativestatic)
+         {                      // Only the modules, not the comments, which have the seed and the date
+            char *to = head;
+            for (char *l = head; l < head + prelude;)
+            {
+               char *e = memchr (l, '\n', head + prelude - l);
+               e = (e ? e + 1 : head + prelude);
+               if (strncmp (l, "//", 2))
+               {
+                  memmove (to, l, e - l);
+                  to += e - l;
+               }
+               l = e;
+            }
+            prelude = to - head;
+         }
+         char scads[parts + 1][32],
+          *stls[parts + 1],
+          *keep[parts + 1];      // Cache file for the static part, if nativestatic
+         int keeps[parts + 1];
+         pid_t pids[parts + 1];
+         for (int p = 1; p <= parts; p++)
+         {
+            stls[p] = keep[p] = NULL;
+            pids[p] = 0;
+            if (nativestatic)
+            {
+               if (!partscad[p])
+                  continue;     // Not making this part
+               unsigned long long h = fnv64 (fnv64 (14695981039346656037ULL, head, prelude), partscad[p], strlen (partscad[p]));
+               if (asprintf (&keep[p], "%s/%016llx.static.stl", cachedir, h) < 0)
+                  errx (1, "malloc");
+               mesh_t **tail = &meshes;
+               while (*tail)
+                  tail = &(*tail)->next;
+               if (!mesh_read_stl (keep[p], &meshes, p))
+               {                // Made before
+                  utimensat (AT_FDCWD, keep[p], NULL, 0);       // Recently used
+                  free (keep[p]);
+                  continue;
+               }
+               mesh_free (*tail);       // Bad file, make it again
+               *tail = NULL;
+               if (asprintf (&stls[p], "%s.%d", keep[p], getpid ()) < 0)
+                  errx (1, "malloc");
+            } else if (!(stls[p] = strdup ("/tmp/XXXXXX.stl")))
+               errx (1, "malloc");
+            int o = scad_temp (scads[p], &keeps[p]);
+            if (!(f = fdopen (o, "w")))
+               err (1, "Cannot make temp");
+            fwrite (head, prelude, 1, f);
+            fprintf (f, "scale(" SCALEI "){\n%s}\n", partscad[p] ? : "");
+            if (fclose (f))
+               err (1, "Cannot write %s", scads[p]);
+            if ((o = (keep[p] ? open (stls[p], O_WRONLY | O_CREAT | O_TRUNC, 0666) : mkstemps (stls[p], 4))) < 0)
+               err (1, "Cannot make temp");
+            close (o);
+            TRACE1 (render_start, p);
+            pids[p] = fork ();
+            if (pids[p] < 0)
+               err (1, "bad fork");
+            if (!pids[p])
+            {                   // Child, waits for a slot, which openscad then keeps until done
+               double waited;
+               int queued;
+               render_slot (renderlock, renderslots, &waited, &queued);
+               if (waited >= 1)
+                  warnx ("Part %d waited %.1fs for render slot (%d queued)", p, waited, queued);
+               if (rendermemory > 0)
+               {
+                  struct rlimit l = {.rlim_cur = (rlim_t) rendermemory * 1024 * 1024,.rlim_max = (rlim_t) rendermemory * 1024 * 1024 };
+                  setrlimit (RLIMIT_AS, &l);
+               }
+               execlp ("openscad", "openscad", "-q", scads[p], "-o", stls[p], NULL);
+               _exit (1);
+            }
+         }
+         free (head);
+         int failed = 0;
+         for (int p = 1; p <= parts; p++)
+         {
+            int status = 0;
+            if (!pids[p])
+               continue;        // Static part from the cache
+            waitpid (pids[p], &status, 0);
+            TRACE2 (render_done, p, status);
+            scad_temp_done (scads[p], keeps[p]);
+            if (!WIFEXITED (status) || WEXITSTATUS (status) || mesh_read_stl (stls[p], &meshes, p))
+               failed = p;
+            if (failed == p || !keep[p] || rename (stls[p], keep[p]))
+               unlink (stls[p]);
+            free (stls[p]);
+            free (keep[p]);
+         }
+         if (failed)
+            errx (1, "openscad failed (part %d)", failed);
+         stage (STAGE_OUTPUT);
+         meshout ();
+      } else
       {
-         unlink (tmp2);
-         errx (1, "openscad failed");
-      }
-      if (!outfile)
-      {                         // To stdout
-         int i = open (tmp2, O_RDONLY);
-         unlink (tmp2);
-         if (i < 0)
-            err (1, "Cannot open %s", tmp2);
-         char buf[1024];
-         int l;
-	 int dummy;
-         while ((l = read (i, buf, sizeof (buf))) > 0)
-	    dummy = write (STDOUT_FILENO, buf, l);
-         close (i);
+         // OpenSCAD is a resource hog, so limited number at a time. Lock releases on file close on exit
+         stage (STAGE_RENDER);
+         int slot = render_slot (renderlock, renderslots, &renderwait, &renderqueue);
+         if (renderwait >= 1)
+            warnx ("Waited %.1fs for render slot (%d queued)", renderwait, renderqueue);
+         char tmp2[] = "/tmp/XXXXXX.stl";
+         if (!outfile)
+         {
+            int o = mkstemps (tmp2, 4);
+            if (o < 0)
+               err (1, "Bad tmp");
+            close (o);
+         }
+         TRACE1 (render_start, 0);
+         pid_t pid = fork ();
+         if (pid < 0)
+            err (1, "bad fork");
+         if (!pid)
+         {                      // Child, keeps slot until done even if we exit
+            if (rendermemory > 0)
+            {
+               struct rlimit l = {.rlim_cur = (rlim_t) rendermemory * 1024 * 1024,.rlim_max = (rlim_t) rendermemory * 1024 * 1024 };
+               setrlimit (RLIMIT_AS, &l);
+            }
+            execlp ("openscad", "openscad", "-q", tmp, "-o", outfile ? : tmp2, NULL);
+            exit (0);
+         }
+         int status = 0;
+         waitpid (pid, &status, 0);
+         TRACE2 (render_done, 0, status);
+         close (slot);
+         scad_temp_done (tmp, tmpkeep);
+         if (!WIFEXITED (status) || WEXITSTATUS (status))
+         {
+            unlink (tmp2);
+            errx (1, "openscad failed");
+         }
+         if (!outfile)
+         {                         // To stdout
+            if (copy_file (tmp2, STDOUT_FILENO))
+               err (1, "Cannot write output from %s", tmp2);
+            unlink (tmp2);
+         }
       }
       
       // Create metadata file with command line parameters and maze data
+      stage (STAGE_META);
       if (outfile && mazedata && mazedatasize > 0)
       {
          char *metafile = NULL;
@@ -2834,6 +5331,9 @@ main (int argc, const char *argv[])
             fprintf (meta, "Created: %04d-%02d-%02dT%02d:%02d:%02dZ\n\n",
                      t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
             
+            if (renderqueue)
+               fprintf (meta, "Render queue: waited %.1fs, %d queued\n\n", renderwait, renderqueue);
+
             // Command line parameters
             fprintf (meta, "Command Line Parameters\n");
             fprintf (meta, "-----------------------\n");
@@ -2878,7 +5378,120 @@ main (int argc, const char *argv[])
          free (metafile);
       }
    }
-   if (mazedata)
-      free (mazedata);
+   if (cachetmp)
+   {                            // Result in cache or temp file, copy to where it goes
+      char *meta = NULL;
+      if (asprintf (&meta, "%s.meta", cachetmp) < 0)
+         errx (1, "malloc");
+      if (cacheout ? copy_file_to (cachetmp, cacheout, compress) : compress_file (cachetmp, STDOUT_FILENO, compress))
+         err (1, "Cannot write %s", cacheout ? : "output");
+      if (!access (meta, R_OK))
+      {
+         char *to = NULL;
+         if (cacheout)
+         {
+            if (asprintf (&to, "%.*s.meta%s", (int) extlen, cacheout, cacheout + extlen) < 0)     // x.stl.gz has x.stl.meta.gz
+               errx (1, "malloc");
+            if (copy_file_to (meta, to, compress))
+               err (1, "Cannot write %s", to);
+            free (to);
+         }
+         if (!cachefile)
+            unlink (meta);
+         else
+         {
+            if (asprintf (&to, "%s.meta", cachefile) < 0)
+               errx (1, "malloc");
+            rename (meta, to);
+            free (to);
+         }
+      }
+      if (!cachefile)
+         unlink (cachetmp);
+      else
+      {
+         if (rename (cachetmp, cachefile))
+            warn ("Cannot cache %s", cachefile);
+         cache_trim (cachedir, (long long) cachesize * 1024 * 1024);
+      }
+      free (meta);
+      free (cachefile);
+      free (cachetmp);
+   }
+   stage (STAGE_OTHER);
+   if (jsonf)
+   {                            // Mazes, and the parts they are on
+      fclose (jsonf);
+      FILE *f = fopen (mazejson, "w");
+      if (!f)
+         err (1, "Cannot open %s", mazejson);
+      fprintf (f, "{\"version\":1,\"seed\":%d,\"parts\":%d,\"part\":[", seed, parts);
+      for (int p = 1; p <= parts; p++)
+         fprintf (f, "%s{\"part\":%d,\"r\":[%.3f,%.3f,%.3f,%.3f],\"entry_angle\":%.3f,\"maze_exit_angle\":%.3f}", p > 1 ? "," : "",
+                  p, part_r0s[p], part_r1s[p], part_r2s[p], part_r3s[p], part_entryas[p], part_mazeexits[p]);
+      fprintf (f, "],\"mazes\":[%s]}\n", json);
+      if (fclose (f))
+         err (1, "Cannot write %s", mazejson);
+      free (json);
+   }
+   if (timings)
+   {
+      double wall = 0,
+         cpu = 0;
+      fprintf (stderr, "%-10s %10s %10s\n", "Stage", "Wall(s)", "CPU(s)");
+      for (int s = 0; s < STAGES; s++)
+      {
+         fprintf (stderr, "%-10s %10.6f %10.6f\n", stage_name[s], stage_wall[s], stage_cpu[s]);
+         wall += stage_wall[s];
+         cpu += stage_cpu[s];
+      }
+      fprintf (stderr, "%-10s %10.6f %10.6f\n", "total", wall, cpu);
+      fprintf (stderr, "Points %ld, faces %ld, bytes %ld\n", npoints, nfaces, bytes);
+   }
+   if (stats)
+   {                            // Counters, to see if the time went on the mazes, the SCAD or the render
+      pb_stats_t g;
+      pb_stats_get (&g);
+      struct
+      {
+         const char *name;
+         unsigned long long v;
+      } c[] = {
+         {"mazes", g.mazes},
+         {"steps", g.steps},
+         {"deadends", g.deadends},
+         {"frontier", g.frontier},
+         {"tests", g.tests},
+         {"probes", g.probes},
+         {"draws", g.draws},
+         {"slices", nslices},
+         {"scan", nscan},
+         {"points", npoints},
+         {"faces", nfaces},
+         {"bytes", bytes},
+      };
+      int json = !strcmp (stats, "json");
+      if (json)
+         fprintf (stderr, "{");
+      for (int i = 0; i < (int) (sizeof (c) / sizeof (*c)); i++)
+         fprintf (stderr, json ? "%s\"%s\":%llu" : "%s%-10s %10llu\n", json && i ? "," : "", c[i].name, c[i].v);
+      if (json)
+      {
+         fprintf (stderr, ",\"renderwait\":%.3f,\"stages\":{", renderwait);
+         for (int s = 0; s < STAGES; s++)
+            fprintf (stderr, "%s\"%s\":{\"wall\":%.6f,\"cpu\":%.6f}", s ? "," : "", stage_name[s], stage_wall[s], stage_cpu[s]);
+         fprintf (stderr, "}}\n");
+      } else
+         fprintf (stderr, "%-10s %10.3f\n", "renderwait", renderwait);
+   }
+   done ();
    return 0;
 }
+
+#ifndef PB_LIBRARY
+int
+main (int argc, const char *argv[])
+{
+   return pb_box (argc, argv, NULL, NULL);
+}
+#endif
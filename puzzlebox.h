@@ -0,0 +1,137 @@
+// Puzzle box maker - maze library
+// (c) 2018 Adrian Kennard www.me.uk @TheRealRevK
+// The maze generation and maze files, and whole boxes as meshes (pb_box, in puzzlebox.c), so tools can work in process
+
+#ifndef PUZZLEBOX_H
+#define PUZZLEBOX_H
+
+#include <stddef.h>
+
+// Flags for maze array
+#define	FLAGL 0x01              // Left
+#define FLAGR 0x02              // Right
+#define FLAGU 0x04              // Up
+#define FLAGD 0x08              // Down
+#define	FLAGA 0x0F              // All directions
+#define	FLAGI 0x80              // Invalid
+
+#define	BIASL	2               // Direction bias for random maze choices
+#define	BIASR	1
+#define	BIASU	1
+#define	BIASD	4
+
+// Random numbers - xoshiro256** so a maze is one seed rather than a read of /dev/urandom for every step
+typedef struct
+{
+   unsigned long long s[4];
+} pb_rng_t;
+
+void pb_rng_seed (pb_rng_t * r, unsigned long long seed);
+unsigned long long pb_rng_next (pb_rng_t * r);
+unsigned int pb_rng_range (pb_rng_t * r, unsigned int n);
+
+// What to make - the size of the maze and where it is cut off top and bottom
+typedef struct pb_params_s pb_params_t;
+struct pb_params_s
+{
+   int W,                       // Cells around
+     H;                         // Cells up, including one above, one below, and abs(helix) below
+   int helix;                   // Rows climbed per turn, negative for clockwise
+   int nubs;                    // Nubs, the maze repeats this many times around
+   int complexity;              // Maze complexity -10 to 10
+   int inside;                  // Maze is on the inside (no "A")
+   int parkvertical;            // Park vertically
+   int noa;                     // No "A" at the park point
+   int testmaze;                // Simple test pattern rather than a maze
+   int exitnub;                 // Exit has to be on a nub position (flip)
+   double step,                 // Cell Y is at y0 + step * Y + dy * X
+     y0,
+     dy;
+   double low,                  // Cells below low or above high are invalid
+     high;
+   int minsolution,             // Targets (0 for none) for pb_maze_search - solution at least this many cells
+     maxvertical,               // No vertical run longer than this, which pb_maze_generate keeps to
+     minchoices;                // At least this many cells on the solution with a way off it
+};
+
+// A maze
+typedef struct pb_maze_s pb_maze_t;
+struct pb_maze_s
+{
+   int W,
+     H,
+     helix,
+     nubs;
+   unsigned char *maze;         // Flags for each cell, indexed x*H+y
+   int exit_x,                  // Exit column
+     exit_y;                    // Row the exit path reached the top, -1 if not known
+   int path;                    // Path length to the exit
+   int allocated;               // maze was allocated by pb_maze_generate
+};
+
+// How good a maze is (see scoring.md)
+typedef struct pb_score_s pb_score_t;
+struct pb_score_s
+{
+   int solution;                // Cells on the solution, park point to exit
+   int choices;                 // Cells on the solution with a way off it
+   int traps;                   // Dead end branches off the solution
+   int trapcells;               // Cells in traps of at least PB_TRAP_MIN cells
+   int smalltraps;              // Traps smaller than that, which are wasted
+   int downtraps;               // Traps that start by going down, which nobody tries
+   int vertical;                // Longest vertical run on the solution
+   int maxtrap;                 // Cells in the biggest trap
+   int turns;                   // Turns on the solution that are not at a corner (where there is a trap)
+   double score;                // Overall, higher is better
+};
+
+#define	PB_TRAP_MIN	3       // Traps smaller than this are wasted
+#define	PB_VERTICAL_MAX	3       // Vertical runs longer than this on the solution count against
+#define	PB_TARGET_TRIES	100     // Sets of candidates pb_maze_search makes looking for a maze that meets the targets
+
+// Counters from the maze generator, for --stats - each thread counts its own, added up by pb_stats_get
+typedef struct pb_stats_s pb_stats_t;
+struct pb_stats_s
+{
+   unsigned long long mazes,    // Mazes generated
+     steps,                     // Cells added to a maze
+     deadends,                  // Cells with only one way in or out
+     tests,                     // pb_maze_test calls
+     probes,                    // Busy cell look ups choosing a way
+     draws;                     // Random numbers
+   int frontier;                // Most points waiting in the queue, for any maze
+};
+
+void pb_stats_get (pb_stats_t * s);
+
+// Output for text - called with each piece of text in turn
+typedef void pb_sink_t (void *ctx, const char *text);
+
+int pb_maze_size (pb_params_t * p, double r, double mazethickness, double base, double height, double margin,
+                  double topspace);
+unsigned char pb_maze_test (const pb_maze_t * m, int x, int y);
+int pb_maze_generate (pb_maze_t * m, const pb_params_t * p, pb_rng_t * rng);
+int pb_maze_solve (const pb_maze_t * m, int *path);
+int pb_maze_reach (const pb_maze_t * m, unsigned char *reached);
+int pb_maze_score (const pb_maze_t * m, pb_score_t * s);
+int pb_maze_targets (const pb_params_t * p, const pb_score_t * s);
+int pb_maze_search (const pb_params_t * p, unsigned long long stream, int candidates, int threads, int keep, pb_maze_t * top,
+                    pb_score_t * tops);
+void pb_maze_free (pb_maze_t * m);
+void pb_maze_write (const pb_maze_t * m, pb_sink_t * sink, void *ctx);
+size_t pb_maze_pack (const pb_maze_t * m, const pb_score_t * s, unsigned char *buf);
+int pb_maze_unpack (const unsigned char *data, size_t len, pb_maze_t * m, pb_score_t * s, int expected_W, int expected_H,
+                    const char *name);
+int pb_maze_save (const char *filename, const pb_maze_t * m, const pb_score_t * s);
+int pb_maze_load (const char *filename, pb_maze_t * m, int expected_W, int expected_H);
+
+// Output for meshes - called with each mesh in turn, np points (x, y, z in mm) and nt triangles (three point numbers,
+// counter-clockwise seen from outside)
+typedef void pb_mesh_sink_t (void *ctx, int part, int np, const double *p, int nt, const int *t);
+
+// Make a box from command line arguments, as puzzlebox does - with a sink it is made as native meshes, each passed to
+// the sink and no files written, returning 1 if the box cannot be made natively (e.g. text); errors in the arguments
+// exit, as on the command line
+int pb_box (int argc, const char *argv[], pb_mesh_sink_t * sink, void *ctx);
+
+#endif
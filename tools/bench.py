@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""Time ../puzzlebox over fixed seeds and representative configs, using --timings.
+
+Usage: tools/bench.py [--puzzlebox PATH] [--seeds N] [--stage]
+
+Prints mean wall time per config (and per stage with --stage), with points, faces and SCAD bytes,
+so changes in speed show up as numbers. The same seeds make the same boxes, so runs compare.
+"""
+from __future__ import annotations
+
+import argparse
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+from typing import Dict, List
+
+# gen_many.py 6 part box, all parts
+GEN_MANY = ['--parts', 6, '--core-diameter', 15, '--core-height', 75, '--nubs', 2, '--base-height', 8,
+            '--clearance', 0.4, '--fix-nubs', '--nub-horizontal', 1.0, '--nub-vertical', 1.0, '--nub-normal', 0.8,
+            '--helix', 0, '--part-thickness', 2, '--park-thickness', 1, '--maze-thickness', 2,
+            '--maze-complexity', 7, '--maze-step', 5, '--maze-margin', 1, '--outer-sides', 0]
+
+CONFIGS = {
+    'gen_many': GEN_MANY,
+    'helix0': ['--helix', 0],
+    'helix2': ['--helix', 2],
+    'helix-2': ['--helix', -2],
+    'inside': ['--inside'],
+    'flip': ['--flip'],
+    'native7': ['--stl', '--native', '--outer-sides', 7],  # Mark pocket on the outer part
+}
+
+
+def run(puzzlebox: str, args: List, seed: int, out: str) -> Dict[str, float]:
+    """Run once, returning stage wall times and the counts."""
+    r = subprocess.run([puzzlebox, '--seed', str(seed), '--timings', '--out-file', out] + [str(a) for a in args],
+                       capture_output=True, text=True)
+    if r.returncode:
+        sys.exit(f'{puzzlebox} failed: {r.stderr}')
+    t: Dict[str, float] = {}
+    for line in r.stderr.splitlines():
+        f = line.split()
+        if len(f) == 3 and f[0] != 'Stage':
+            t[f[0]] = float(f[1])
+        elif f and f[0] == 'Points':  # Points N, faces N, bytes N
+            t['#points'], t['#faces'], t['#bytes'] = (float(x.strip(',')) for x in f[1::2])
+    return t
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark puzzlebox')
+    parser.add_argument('--puzzlebox', default=os.path.join(os.path.dirname(os.path.abspath(__file__)), '../puzzlebox'))
+    parser.add_argument('--seeds', type=int, default=5, help='Seeds per config (1..N)')
+    parser.add_argument('--stage', action='store_true', help='Show each stage')
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as tmp:
+        out = os.path.join(tmp, 'bench.scad')
+        print(f'{"Config":<10} {"Wall(ms)":>9} {"Points":>8} {"Faces":>8} {"KiB":>8}')
+        for name, config in CONFIGS.items():
+            runs = [run(args.puzzlebox, config, seed, out) for seed in range(1, args.seeds + 1)]
+            mean = {k: statistics.mean(r.get(k, 0) for r in runs) for k in runs[0]}
+            print(f'{name:<10} {mean["total"] * 1000:9.2f} {mean["#points"]:8.0f} {mean["#faces"]:8.0f} '
+                  f'{mean["#bytes"] / 1024:8.0f}')
+            if args.stage:
+                for k, v in mean.items():
+                    if k != 'total' and not k.startswith('#') and v:
+                        print(f'  {k:<10} {v * 1000:9.2f}')
+
+
+if __name__ == '__main__':
+    main()
@@ -1,10 +1,11 @@
 #!/usr/bin/env python3
 
 import sys,os,os.path
-import argparse,tempfile,itertools,subprocess,json,datetime
+import argparse,tempfile,itertools,json,datetime
 
 sys.path.append(os.path.dirname(os.path.abspath(__file__)))
 import parse_maze_comments as analyze
+import libpuzzlebox as pb
 
 
 class Leaderboard:
@@ -71,24 +72,21 @@ def gen_maze( puzzlebox_args, part=1, count=100, keep=3, parts=6, leaders=None )
 
     cmdline_args.extend(['--part', part])
 
-    puzzlebox_exe = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)),'../puzzlebox'))
-
     if part == parts:
         count = 1
 
     for i in range(count):
-        with tempfile.NamedTemporaryFile(suffix='.scad',delete=False) as tmpscad:
-            tmpscad.close() # release lock
-            command = [ puzzlebox_exe ] + list(map(str,cmdline_args)) + [
-                '--out-file', tmpscad.name,
+        with tempfile.NamedTemporaryFile(suffix='.json',delete=False) as tmpjson:
+            tmpjson.close() # release lock
+            command = list(map(str,cmdline_args)) + [
+                '--maze-json', tmpjson.name,
             ]
             
             #print(f'Command: {command}')
-            result = subprocess.run(command)
-            result.check_returncode()
+            meshes = pb.box(command)  # In process, as native meshes, no SCAD to parse
+            if meshes is None:
+                raise RuntimeError(f'Cannot make part {part} natively: {command}')
 
-            with open(tmpscad.name,'rt',encoding='utf-8') as _in:
-                scad = _in.read()
             try:
                 score_maze = True
                 if '--inside' in cmdline_args:
@@ -98,15 +96,15 @@ def gen_maze( puzzlebox_args, part=1, count=100, keep=3, parts=6, leaders=None )
                     if part >= parts:
                         score_maze = False
                 if score_maze:
-                    score,maze,metrics = analyze.score_file(tmpscad.name,weights='')
-                    leaders.add(score,i,maze,metrics,scad)
+                    score,maze,metrics = analyze.score_parsed(analyze.parse_maze_json(tmpjson.name)[0],weights='')
+                    leaders.add(score,i,maze,metrics,meshes)
                 else:
                     # The last part has no maze, and thus, no score or analysis.
-                    leaders.add(1,i,None,{},scad)
+                    leaders.add(1,i,None,{},meshes)
             except Exception as e:
-                emit(f'Error attempting to score maze.\n#{i} ({tmpscad.name}) part({part}/{parts})\n{command}\n{e}\n{scad}')
+                emit(f'Error attempting to score maze.\n#{i} ({tmpjson.name}) part({part}/{parts})\n{command}\n{e}')
 
-            os.remove(tmpscad.name)
+            os.remove(tmpjson.name)
 
     return leaders
 
@@ -150,25 +148,20 @@ if __name__ == '__main__':
         for score,info in lead.keep:
             emit(f'\n\n{"=" * 60}')
             lead_index += 1
-            idx,maze,metrics,scad = info
+            idx,maze,metrics,meshes = info
             emit(f'Score: {score}')
             if 'human_readable' in metrics:
                 emit('\n'.join(metrics['human_readable']['solution']))
-            outfile = f'part-{part_number}.{lead_index:02d}.scad'
-            with open(outfile, 'wt', encoding='utf-8') as _out:
-                print(scad,file=_out)
-            emit(outfile)
+            outfile = f'part-{part_number}.{lead_index:02d}.stl'
+            started = datetime.datetime.now()
+            pb.write_stl(outfile, meshes)
+            elapsed = datetime.datetime.now() - started
+            emit(f'  {outfile}: {elapsed}')
             with open(f'{outfile}.meta', 'wt', encoding='utf-8') as _out:
                 emit(f'Difficulty Score: {score}', file=_out)
                 metrics_json = dict(metrics)
                 metrics_json.pop('human_readable', None)
                 emit(json.dumps(metrics_json, indent=2),file=_out)
                 if 'human_readable' in metrics:
-                    emit(f'\n\n{"\n".join(metrics["human_readable"]["visualization"])}',file=_out)
-                    emit(f'\n\n{"\n".join(metrics["human_readable"]["solution"])}',file=_out)
-
-            emit('\nGenerating STL')
-            started = datetime.datetime.now()
-            result = subprocess.run([ 'openscad', '-q', outfile, '-o', f'{outfile}.stl'])
-            elapsed = datetime.datetime.now() - started
-            emit(f'  {outfile}.stl: {elapsed}')
+                    emit('\n\n' + '\n'.join(metrics['human_readable']['visualization']),file=_out)
+                    emit('\n\n' + '\n'.join(metrics['human_readable']['solution']),file=_out)
@@ -1,14 +1,15 @@
 #!/usr/bin/env python3
 
-import sys, os, os.path, subprocess, datetime, argparse, multiprocessing, itertools
+import sys, os, os.path, datetime, argparse, multiprocessing, itertools
+
+sys.path.append(os.path.dirname(os.path.abspath(__file__)))
+import libpuzzlebox as pb
 
 def gen_puzzle( args ):
     index, complexity, out_dir = args
     for part in range(1,6):
-        outfile = f'{out_dir}/maze.part-{part:02d}.cplx-{complexity:02d}.{index:03d}.scad'
+        outfile = f'{out_dir}/maze.part-{part:02d}.cplx-{complexity:02d}.{index:03d}.stl'
         command = [
-            '../puzzlebox',
-
             '--parts', 6,            # 5 parts, 4 mazes
             '--part', part,          # which part? (0:all, 1:innermost, ..., <n>:outer)
             '--core-diameter', 15,   # size of empty space in smallest
@@ -31,15 +32,15 @@ def gen_puzzle( args ):
             '--maze-step', 5,        # maze spacing (mm); the (centerline) distance between one cell and the next
             '--maze-margin', 1,      # maze top margin (mm)
             '--outer-sides', 0,      # side count (0: round)
-
-            #'--stl',
-            '--out-file', outfile,
         ]        
 
         print(f'{outfile}')
         sys.stdout.flush()
         started = datetime.datetime.now()
-        subprocess.run(list(map(str,command)))
+        meshes = pb.box(list(map(str,command)))  # In process, as native meshes
+        if meshes is None:
+            raise RuntimeError(f'Cannot make {outfile} natively')
+        pb.write_stl(outfile, meshes)
         elapsed = datetime.datetime.now() - started
         info = os.stat(outfile)
         print(f'{outfile}: {info.st_size/1024/1024:.2f} MiB\n    {elapsed}')
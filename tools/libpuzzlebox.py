@@ -0,0 +1,354 @@
+#!/usr/bin/env python3
+"""Make PuzzleBox mazes in process using libpuzzlebox.so (make libpuzzlebox.so).
+
+Usage: tools/libpuzzlebox.py [--count N] [--seed S] [--radius R] [--height H] [--builtin] ...
+
+Makes --count mazes and prints the best by parse_maze_comments.score_maze (or the built-in score
+with --builtin), without running ../puzzlebox or parsing SCAD.
+Set PUZZLEBOX_LIB to use a library other than ../libpuzzlebox.so.
+
+box() makes a whole box from puzzlebox arguments in process, as meshes (see pb_box in puzzlebox.h),
+and write_stl() writes them, so tools need neither ../puzzlebox nor openscad.
+"""
+from __future__ import annotations
+
+import argparse
+import ctypes
+import math
+import os
+import struct
+import sys
+from typing import List, Optional, Tuple
+
+sys.path.append(os.path.dirname(os.path.abspath(__file__)))
+import parse_maze_comments as analyze
+
+FLAGI = analyze.FLAGI
+
+
+class _Rng(ctypes.Structure):
+    _fields_ = [('s', ctypes.c_ulonglong * 4)]
+
+
+class Params(ctypes.Structure):
+    """pb_params_t - see puzzlebox.h"""
+    _fields_ = [
+        ('W', ctypes.c_int),
+        ('H', ctypes.c_int),
+        ('helix', ctypes.c_int),
+        ('nubs', ctypes.c_int),
+        ('complexity', ctypes.c_int),
+        ('inside', ctypes.c_int),
+        ('parkvertical', ctypes.c_int),
+        ('noa', ctypes.c_int),
+        ('testmaze', ctypes.c_int),
+        ('exitnub', ctypes.c_int),
+        ('step', ctypes.c_double),
+        ('y0', ctypes.c_double),
+        ('dy', ctypes.c_double),
+        ('low', ctypes.c_double),
+        ('high', ctypes.c_double),
+        ('minsolution', ctypes.c_int),
+        ('maxvertical', ctypes.c_int),
+        ('minchoices', ctypes.c_int),
+    ]
+
+
+class _Maze(ctypes.Structure):
+    _fields_ = [
+        ('W', ctypes.c_int),
+        ('H', ctypes.c_int),
+        ('helix', ctypes.c_int),
+        ('nubs', ctypes.c_int),
+        ('maze', ctypes.POINTER(ctypes.c_ubyte)),
+        ('exit_x', ctypes.c_int),
+        ('exit_y', ctypes.c_int),
+        ('path', ctypes.c_int),
+        ('allocated', ctypes.c_int),
+    ]
+
+
+class Score(ctypes.Structure):
+    """pb_score_t - see puzzlebox.h and scoring.md"""
+    _fields_ = [
+        ('solution', ctypes.c_int),
+        ('choices', ctypes.c_int),
+        ('traps', ctypes.c_int),
+        ('trapcells', ctypes.c_int),
+        ('smalltraps', ctypes.c_int),
+        ('downtraps', ctypes.c_int),
+        ('vertical', ctypes.c_int),
+        ('maxtrap', ctypes.c_int),
+        ('turns', ctypes.c_int),
+        ('score', ctypes.c_double),
+    ]
+
+
+class Stats(ctypes.Structure):
+    """pb_stats_t - generator counters, as --stats"""
+    _fields_ = [
+        ('mazes', ctypes.c_ulonglong),
+        ('steps', ctypes.c_ulonglong),
+        ('deadends', ctypes.c_ulonglong),
+        ('tests', ctypes.c_ulonglong),
+        ('probes', ctypes.c_ulonglong),
+        ('draws', ctypes.c_ulonglong),
+        ('frontier', ctypes.c_int),
+    ]
+
+
+_SINK = ctypes.CFUNCTYPE(None, ctypes.c_void_p, ctypes.c_char_p)
+_MESH_SINK = ctypes.CFUNCTYPE(None, ctypes.c_void_p, ctypes.c_int, ctypes.c_int, ctypes.POINTER(ctypes.c_double),
+                              ctypes.c_int, ctypes.POINTER(ctypes.c_int))
+
+
+def _load(path: Optional[str] = None) -> ctypes.CDLL:
+    if path is None:
+        path = os.environ.get('PUZZLEBOX_LIB') or os.path.normpath(
+            os.path.join(os.path.dirname(os.path.abspath(__file__)), '../libpuzzlebox.so'))
+    lib = ctypes.CDLL(path)
+    lib.pb_rng_seed.argtypes = [ctypes.POINTER(_Rng), ctypes.c_ulonglong]
+    lib.pb_rng_seed.restype = None
+    lib.pb_maze_size.argtypes = [ctypes.POINTER(Params)] + [ctypes.c_double] * 6
+    lib.pb_maze_size.restype = ctypes.c_int
+    lib.pb_maze_generate.argtypes = [ctypes.POINTER(_Maze), ctypes.POINTER(Params), ctypes.POINTER(_Rng)]
+    lib.pb_maze_generate.restype = ctypes.c_int
+    lib.pb_maze_solve.argtypes = [ctypes.POINTER(_Maze), ctypes.POINTER(ctypes.c_int)]
+    lib.pb_maze_solve.restype = ctypes.c_int
+    lib.pb_maze_score.argtypes = [ctypes.POINTER(_Maze), ctypes.POINTER(Score)]
+    lib.pb_maze_score.restype = ctypes.c_int
+    lib.pb_maze_search.argtypes = [ctypes.POINTER(Params), ctypes.c_ulonglong, ctypes.c_int, ctypes.c_int, ctypes.c_int,
+                                   ctypes.POINTER(_Maze), ctypes.POINTER(Score)]
+    lib.pb_maze_search.restype = ctypes.c_int
+    lib.pb_maze_free.argtypes = [ctypes.POINTER(_Maze)]
+    lib.pb_maze_free.restype = None
+    lib.pb_maze_write.argtypes = [ctypes.POINTER(_Maze), _SINK, ctypes.c_void_p]
+    lib.pb_maze_write.restype = None
+    lib.pb_maze_save.argtypes = [ctypes.c_char_p, ctypes.POINTER(_Maze), ctypes.POINTER(Score)]
+    lib.pb_maze_save.restype = ctypes.c_int
+    lib.pb_maze_load.argtypes = [ctypes.c_char_p, ctypes.POINTER(_Maze), ctypes.c_int, ctypes.c_int]
+    lib.pb_maze_load.restype = ctypes.c_int
+    lib.pb_maze_pack.argtypes = [ctypes.POINTER(_Maze), ctypes.POINTER(Score), ctypes.c_void_p]
+    lib.pb_maze_pack.restype = ctypes.c_size_t
+    lib.pb_stats_get.argtypes = [ctypes.POINTER(Stats)]
+    lib.pb_stats_get.restype = None
+    lib.pb_box.argtypes = [ctypes.c_int, ctypes.POINTER(ctypes.c_char_p), _MESH_SINK, ctypes.c_void_p]
+    lib.pb_box.restype = ctypes.c_int
+    return lib
+
+
+class Mesh:
+    """A mesh of a box: points (x, y, z in mm) and triangles (point numbers, counter-clockwise from outside)."""
+
+    def __init__(self, part: int, points: List[Tuple[float, float, float]], triangles: List[Tuple[int, int, int]]):
+        self.part = part
+        self.points = points
+        self.triangles = triangles
+
+
+def box(args: List[str], lib: Optional[ctypes.CDLL] = None) -> Optional[List[Mesh]]:
+    """Make a box from puzzlebox arguments (e.g. ['--seed', '1', '--part', '2']) as native meshes.
+
+    None if it cannot be made natively (e.g. text or a logo), errors in the arguments exit as puzzlebox does.
+    """
+    lib = lib or _load()
+    meshes: List[Mesh] = []
+
+    def sink(ctx, part, np, p, nt, t):
+        meshes.append(Mesh(part, [(p[i * 3], p[i * 3 + 1], p[i * 3 + 2]) for i in range(np)],
+                           [(t[i * 3], t[i * 3 + 1], t[i * 3 + 2]) for i in range(nt)]))
+
+    argv = (ctypes.c_char_p * (len(args) + 2))(b'puzzlebox', *[a.encode() for a in args], None)
+    if lib.pb_box(len(args) + 1, argv, _MESH_SINK(sink), None):
+        return None
+    return meshes
+
+
+def write_stl(filename: str, meshes: List[Mesh]):
+    """Write meshes as one binary STL, as puzzlebox --stl --native does."""
+    count = sum(len(m.triangles) for m in meshes)
+    with open(filename, 'wb') as f:
+        f.write(b'Puzzlebox by RevK, @TheRealRevK www.me.uk'.ljust(80, b'\0') + struct.pack('<I', count))
+        for m in meshes:
+            for t in m.triangles:
+                a, b, c = (m.points[i] for i in t)
+                u = [b[j] - a[j] for j in range(3)]
+                v = [c[j] - a[j] for j in range(3)]
+                n = (u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0])
+                d = math.sqrt(sum(x * x for x in n)) or 1
+                f.write(struct.pack('<12fH', *(x / d for x in n), *a, *b, *c, 0))
+
+
+class Maze:
+    """A generated maze: grid[x][y] flags as in puzzlebox.c, plus exit column/row and path length."""
+
+    def __init__(self, lib: ctypes.CDLL, m: _Maze, inside: bool):
+        self._lib = lib
+        self._m = m
+        self.W = m.W
+        self.H = m.H
+        self.helix = m.helix
+        self.nubs = m.nubs
+        self.inside = inside
+        self.exit_x = m.exit_x
+        self.exit_y = m.exit_y
+        self.path = m.path
+        cells = m.maze[:m.W * m.H]
+        self.grid: List[List[int]] = [cells[x * m.H:(x + 1) * m.H] for x in range(m.W)]
+
+    def __del__(self):
+        self._lib.pb_maze_free(ctypes.byref(self._m))
+
+    def score(self) -> Optional[Score]:
+        """Built-in score (as --candidates), None if there is no solution."""
+        s = Score()
+        e = self._lib.pb_maze_score(ctypes.byref(self._m), ctypes.byref(s))
+        if e < 0:
+            raise MemoryError("pb_maze_score")
+        if e:
+            return None
+        return s
+
+    def solution(self) -> List[Tuple[int, int]]:
+        """The cells (x, y) from the park point to the exit, empty if there is no solution."""
+        path = (ctypes.c_int * (self.W * self.H))()
+        n = self._lib.pb_maze_solve(ctypes.byref(self._m), path)
+        if n < 0:
+            raise MemoryError("pb_maze_solve")
+        return [(c // self.H, c % self.H) for c in path[:n]]
+
+    def text(self) -> str:
+        """The maze in maze file format (as --save-maze-inside/--save-maze-outside)."""
+        out: List[str] = []
+        self._lib.pb_maze_write(ctypes.byref(self._m), _SINK(lambda ctx, t: out.append(t.decode())), None)
+        return ''.join(out)
+
+    def save(self, filename: str, score: Optional[Score] = None):
+        """Save to a maze file for --load-maze-inside/--load-maze-outside, binary if it ends .pbmz."""
+        if self._lib.pb_maze_save(filename.encode(), ctypes.byref(self._m), ctypes.byref(score) if score else None):
+            raise OSError(f'Cannot save maze to {filename}')
+
+    def pack(self, score: Optional[Score] = None) -> bytes:
+        """The maze in binary (.pbmz) format."""
+        s = ctypes.byref(score) if score else None
+        n = self._lib.pb_maze_pack(ctypes.byref(self._m), s, None)
+        buf = ctypes.create_string_buffer(n)
+        self._lib.pb_maze_pack(ctypes.byref(self._m), s, buf)
+        return buf.raw
+
+    @classmethod
+    def load(cls, filename: str, lib: Optional[ctypes.CDLL] = None, inside: bool = False, nubs: int = 0) -> 'Maze':
+        """Load a maze file (text, .pbmz, or .pbmc collection with #N) - text files do not have the nubs, so give them."""
+        lib = lib or _load()
+        m = _Maze(nubs=nubs)
+        if lib.pb_maze_load(filename.encode(), ctypes.byref(m), 0, 0):
+            raise OSError(f'Cannot load maze from {filename}')
+        return cls(lib, m, inside)
+
+    def analysis(self) -> analyze.Maze:
+        """The maze as parse_maze_comments.Maze, with the solution found, for its scoring.
+
+        The rows are the raw grid, the other nub copies of the maze are not filled in as they
+        are in the SCAD visualization, which does not change the solution.
+        """
+        W, H, helix = self.W, self.H, self.helix
+        valid = [y for y in range(H) if any(not (self.grid[x][y] & FLAGI) for x in range(W))]
+        miny, maxy = (valid[0], valid[-1]) if valid else (0, H - 1)
+        a = analyze.Maze(W, maxy - miny + 1, 'INSIDE' if self.inside else 'OUTSIDE', miny, maxy,
+                         maxx=self.exit_x, helix=helix)
+        for y in range(miny, maxy + 1):
+            a.set_row(y, [self.grid[x][y] for x in range(W)])
+        a.entrance_x = W // self.nubs - 1 if helix < 0 else 0
+        a.exit_x_val = self.exit_x
+        a.maxy_exit = self.exit_y if self.exit_y >= 0 else maxy
+        a.find_entry_exit_points()
+        a.solution = a.find_solution()
+        return a
+
+
+class Generator:
+    """Makes mazes from a seed, each call continuing the same random stream."""
+
+    def __init__(self, seed: int, lib: Optional[ctypes.CDLL] = None):
+        self.seed = seed
+        self._lib = lib or _load()
+        self._rng = _Rng()
+        self._lib.pb_rng_seed(ctypes.byref(self._rng), seed)
+
+    def params(self, r: float, base: float, height: float, mazestep: float = 3, mazethickness: float = 2,
+               margin: float = 1, topspace: float = 0, helix: int = 2, nubs: int = 2, complexity: int = 5,
+               inside: bool = False, parkvertical: bool = False, noa: bool = False, min_solution: int = 0,
+               max_vertical: int = 0, min_choices: int = 0) -> Params:
+        """Params for a maze on a wall of radius r, sized as puzzlebox.c does, with targets for search."""
+        p = Params(helix=helix, nubs=nubs, complexity=complexity, inside=int(inside),
+                   parkvertical=int(parkvertical), noa=int(noa), step=mazestep, minsolution=min_solution,
+                   maxvertical=max_vertical, minchoices=min_choices)
+        if self._lib.pb_maze_size(ctypes.byref(p), r, mazethickness, base, height, margin, topspace):
+            raise ValueError('Too small')
+        return p
+
+    def generate(self, p: Params) -> Maze:
+        m = _Maze()
+        if self._lib.pb_maze_generate(ctypes.byref(m), ctypes.byref(p), ctypes.byref(self._rng)):
+            raise RuntimeError('Failed to make maze')
+        return Maze(self._lib, m, bool(p.inside))
+
+    def search(self, p: Params, candidates: int, keep: int = 1, threads: int = 0) -> List[Tuple[Score, Maze]]:
+        """Best of candidates by the built-in score (as --candidates), made on threads (0 for one per core)."""
+        top = (_Maze * keep)()
+        tops = (Score * keep)()
+        n = self._lib.pb_maze_search(ctypes.byref(p), self.seed, candidates, threads, keep, top, tops)
+        if n < 0:
+            raise RuntimeError('Failed to make maze')
+        return [(tops[i], Maze(self._lib, top[i], bool(p.inside))) for i in range(n)]
+
+    def stats(self) -> Stats:
+        """Generator counters so far, for every maze made in this process."""
+        s = Stats()
+        self._lib.pb_stats_get(ctypes.byref(s))
+        return s
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Make mazes in process and show the best')
+    parser.add_argument('--count', type=int, default=100)
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--radius', type=float, default=20, help='Radius of wall with maze (mm)')
+    parser.add_argument('--base', type=float, default=8, help='Height of bottom of maze area (mm)')
+    parser.add_argument('--height', type=float, default=60, help='Height of part (mm)')
+    parser.add_argument('--maze-step', type=float, default=3)
+    parser.add_argument('--helix', type=int, default=2)
+    parser.add_argument('--nubs', type=int, default=2)
+    parser.add_argument('--maze-complexity', type=int, default=5)
+    parser.add_argument('--inside', action='store_true')
+    parser.add_argument('--builtin', action='store_true', help='Use the built-in score (as --candidates)')
+    parser.add_argument('--min-solution', type=int, default=0, help='Targets with --builtin (see scoring.md)')
+    parser.add_argument('--max-vertical', type=int, default=0)
+    parser.add_argument('--min-choices', type=int, default=0)
+    parser.add_argument('--threads', type=int, default=0, help='Threads with --builtin (0 for one per core)')
+    parser.add_argument('--save', help='Save best maze to this file')
+    args = parser.parse_args()
+
+    gen = Generator(args.seed)
+    p = gen.params(args.radius, args.base, args.height, mazestep=args.maze_step, helix=args.helix,
+                   nubs=args.nubs, complexity=args.maze_complexity, inside=args.inside,
+                   min_solution=args.min_solution, max_vertical=args.max_vertical, min_choices=args.min_choices)
+    if args.builtin:
+        s, maze = gen.search(p, args.count, threads=args.threads)[0]
+        print(f'Best of {args.count}: score {s.score:.2f} solution {s.solution} traps {s.traps} '
+              f'exit {maze.exit_x} ({maze.W}x{maze.H})')
+    else:
+        best = None
+        for i in range(args.count):
+            maze = gen.generate(p)
+            score = analyze.score_maze(maze.analysis())
+            if best is None or score > best[0]:
+                best = (score, i, maze)
+        score, i, maze = best
+        print(f'Best #{i} of {args.count}: score {score:.2f} path {maze.path} exit {maze.exit_x} ({maze.W}x{maze.H})')
+    if args.save:
+        maze.save(args.save)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+"""Pack maze files into a collection for --load-maze-inside/--load-maze-outside.
+
+Usage: tools/pack_mazes.py [--nubs N] out.pbmc maze [maze...]
+
+Each maze is a saved maze file (text or .pbmz, a directory for all files in it), scored with the
+built-in score (as --candidates). Loading out.pbmc picks the best scoring maze of the size needed,
+or out.pbmc#N picks maze N (from 1, in the order listed). Uses libpuzzlebox.so (make libpuzzlebox.so).
+"""
+from __future__ import annotations
+
+import argparse
+import os
+import struct
+import sys
+
+sys.path.append(os.path.dirname(os.path.abspath(__file__)))
+import libpuzzlebox as pb
+
+HEADER = struct.Struct('<4sIII')  # PBMC, version, count, reserved
+ENTRY = struct.Struct('<IIHHhHf')  # offset, size, W, H, helix, reserved, score
+
+
+def files(paths):
+    for p in paths:
+        if os.path.isdir(p):
+            for f in sorted(os.listdir(p)):
+                if os.path.isfile(os.path.join(p, f)):
+                    yield os.path.join(p, f)
+        else:
+            yield p
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Pack maze files into a .pbmc collection')
+    parser.add_argument('output')
+    parser.add_argument('mazes', nargs='+', help='Maze files or directories of them')
+    parser.add_argument('--nubs', type=int, default=0, help='Nubs the text mazes were made for (text files do not say)')
+    args = parser.parse_args()
+
+    lib = pb._load()
+    blobs = []
+    for f in files(args.mazes):
+        try:
+            maze = pb.Maze.load(f, lib, nubs=args.nubs)
+        except OSError as e:
+            print(f'{f}: {e}, skipped', file=sys.stderr)
+            continue
+        if not maze.nubs:
+            print(f'{f}: text maze needs --nubs, skipped', file=sys.stderr)
+            continue
+        s = maze.score()
+        blobs.append((maze, s.score if s else 0.0, maze.pack(s)))
+    offset = HEADER.size + ENTRY.size * len(blobs)
+    with open(args.output, 'wb') as o:
+        o.write(HEADER.pack(b'PBMC', 1, len(blobs), 0))
+        for maze, score, blob in blobs:
+            o.write(ENTRY.pack(offset, len(blob), maze.W, maze.H, maze.helix, 0, score))
+            offset += len(blob)
+        for _, _, blob in blobs:
+            o.write(blob)
+    print(f'Packed {len(blobs)} mazes into {args.output}')
+
+
+if __name__ == '__main__':
+    main()
@@ -410,6 +410,45 @@ def score_maze( maze: Maze ) -> float:
     score += len(maze.solution) * .05
     return score
 
+def parse_compact(line: str) -> Maze:
+    """Parse a maze from a MAZE_COMPACT line (--annotations compact): the MAZE_START fields then each row as hex."""
+    f = line.split('MAZE_COMPACT', 1)[1].split()
+    orientation = f[0].upper()
+    W, H, maxx, helix, miny, maxy, entrance_x, exit_x, maxy_exit = (int(v) for v in f[1:10])
+    maze = Maze(W, H, orientation, miny, maxy, maxx=maxx, helix=helix)
+    maze.entrance_x = entrance_x
+    maze.exit_x_val = exit_x
+    maze.maxy_exit = maxy_exit
+    for y, row in zip(range(miny, maxy + 1), f[10:]):
+        maze.set_row(y, [int(row[i:i + 2], 16) for i in range(0, len(row), 2)])
+    maze.find_entry_exit_points()
+    maze.solution = maze.find_solution()
+    return maze
+
+
+def parse_maze_json(path: str) -> List[Maze]:
+    """Parse the mazes from a --maze-json file: each grid row is hex, the raw maze as made."""
+    with open(path, 'r', encoding='utf-8') as fh:
+        data = json.load(fh)
+    mazes = []
+    for m in data['mazes']:
+        W, H, helix = m['W'], m['H'], m['helix']
+        rows = [[int(r[i:i + 2], 16) for i in range(0, len(r), 2)] for r in m['grid']]
+        valid = [y for y in range(H) if any(not (c & FLAGI) for c in rows[y])]
+        miny, maxy = (valid[0], valid[-1]) if valid else (0, H - 1)
+        maze = Maze(W, maxy - miny + 1, m['side'].upper(), miny, maxy, maxx=m['exit'][0], helix=helix)
+        for y in range(miny, maxy + 1):
+            maze.set_row(y, rows[y])
+        maze.entrance_x = m['entrance'][0]
+        maze.exit_x_val = m['exit'][0]
+        maze.maxy_exit = m['exit'][1] if m['exit'][1] >= 0 else maxy
+        maze.part = m['part']
+        maze.find_entry_exit_points()
+        maze.solution = maze.find_solution()
+        mazes.append(maze)
+    return mazes
+
+
 def parse_machine_readable(lines: List[str]) -> Maze:
     start_re = re.compile(r"MAZE_START\s+(INSIDE|OUTSIDE)\s+(\d+)\s+(\d+)\s+(\d+)\s+(-?\d+)\s+(-?\d+)\s+(-?\d+)(?:\s+(-?\d+)\s+(-?\d+)(?:\s+(-?\d+))?)?", re.I)
     row_re = re.compile(r"MAZE_ROW\s+(-?\d+)\s+(.+)", re.I)
@@ -417,6 +456,9 @@ def parse_machine_readable(lines: List[str]) -> Maze:
     # locate machine-readable block start
     mr_idx = next((i for i, l in enumerate(lines) if 'machine-readable maze data:' in l.lower()), None)
     if mr_idx is None:
+        compact = next((l for l in lines if 'MAZE_COMPACT' in l), None)
+        if compact is not None:
+            return parse_compact(compact)
         raise RuntimeError("No machine-readable maze data found")
 
     # look backwards for a Part comment near the block
@@ -645,15 +687,18 @@ def extract_human_readable(lines: List[str], mr_idx: int) -> Dict[str, Optional[
 
 def main():
     ap = argparse.ArgumentParser()
-    ap.add_argument('file', help='OpenSCAD file or exported comments file')
+    ap.add_argument('file', help='OpenSCAD file, exported comments file, or --maze-json file (first maze)')
     ap.add_argument('--weights', help='Comma separated key=val weights (connected,unreachable,dead_end,branching,avg_degree)')
     ap.add_argument('--json', action='store_true', help='Output JSON metrics+score to stdout')
     args = ap.parse_args()
 
-    with open(args.file, 'r', encoding='utf-8', errors='ignore') as fh:
-        lines = fh.readlines()
-
-    maze = parse_machine_readable(lines)
+    if args.file.endswith('.json'):
+        lines = []
+        maze = parse_maze_json(args.file)[0]
+    else:
+        with open(args.file, 'r', encoding='utf-8', errors='ignore') as fh:
+            lines = fh.readlines()
+        maze = parse_machine_readable(lines)
 
     # extract human-readable blocks near the machine-readable data
     try:
@@ -664,6 +709,20 @@ def main():
     if mr_idx is not None:
         hr = extract_human_readable(lines, mr_idx)
 
+    return score_parsed(maze, weights, hr)
+
+
+def score_parsed(maze, weights, hr=None):
+    """Score a parsed maze (e.g. from parse_maze_json) as score_file does.
+
+    Args:
+        maze: The maze, with its solution
+        weights: Weight string for scoring
+        hr: Human-readable blocks for the metrics, if any
+
+    Returns:
+        Tuple of (score, maze, metrics)
+    """
     metrics = analyze_maze(maze)
     default_weights = {"connected": 2.0, "unreachable": -5.0, "dead_end": -1.0, "branching": 1.0, "avg_degree": 1.0}
     override = parse_weights(args.weights)
@@ -724,6 +783,20 @@ def score_file(mpath, weights):
     if mr_idx is not None:
         hr = extract_human_readable(lines, mr_idx)
 
+    return score_parsed(maze, weights, hr)
+
+
+def score_parsed(maze, weights, hr=None):
+    """Score a parsed maze (e.g. from parse_maze_json) as score_file does.
+
+    Args:
+        maze: The maze, with its solution
+        weights: Weight string for scoring
+        hr: Human-readable blocks for the metrics, if any
+
+    Returns:
+        Tuple of (score, maze, metrics)
+    """
     metrics = analyze_maze(maze)
     default_weights = {"connected": 2.0, "unreachable": -5.0, "dead_end": -1.0, "branching": 1.0, "avg_degree": 1.0}
     override = parse_weights(weights)